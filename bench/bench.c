@@ -0,0 +1,298 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "lstm.h"
+#include "thread_pool.h"
+
+/*
+Times lstm_forward_batch and the kernels of its hot path over a grid of shapes and prints JSON on stdout.
+
+    ./lstm_bench [-w warmup] [-r repetitions] [-f flags] [-q]
+
+-f takes the lstm_flags bits, -q runs a small grid. Progress goes to stderr
+*/
+
+#define BENCH_WARMUP 3
+#define BENCH_REPETITIONS 20
+
+typedef struct bench_options{
+    int warmup;
+    int repetitions;
+    int flags;
+    int quick;
+} bench_options;
+
+/*
+Work of one timed call, used to turn times into rates
+*/
+typedef struct bench_work{
+    double flops;
+    double bytes;
+    // timesteps per call, 0 for kernels
+    int steps;
+} bench_work;
+
+typedef void (*bench_fn)(void * context);
+
+static int first_result = 1;
+
+static inline long now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static inline long peak_rss_kb(void){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static int compare_long(const void * a, const void * b){
+    long x = *(const long *)a;
+    long y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+static inline long percentile(const long * sorted, int count, double p){
+    int index = (int)(p * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+/*
+Runs fn warmup times untimed, then repetitions timed calls, and prints one JSON result
+*/
+static void bench_run(bench_options * options, const char * name, int hidden, int steps, int batch, 
+    bench_fn fn, void * context, bench_work work, double error){
+    for(int i = 0; i < options->warmup; i++){
+        fn(context);
+    }
+
+    long * times = (long *)SAFE_MALLOC(sizeof(long) * options->repetitions);
+    double total = 0;
+
+    for(int i = 0; i < options->repetitions; i++){
+        long start = now_ns();
+        fn(context);
+        times[i] = now_ns() - start;
+        total += times[i];
+    }
+
+    qsort(times, options->repetitions, sizeof(long), compare_long);
+
+    long median = percentile(times, options->repetitions, 0.5);
+    // rates from the median, the mean is skewed by preemption
+    double seconds = median * 1e-9;
+
+    printf("%s    {\"name\": \"%s\", \"hidden\": %d, \"steps\": %d, \"batch\": %d, \"repetitions\": %d,\n", 
+        first_result ? "" : ",\n", name, hidden, steps, batch, options->repetitions
+    );
+    printf("     \"ns\": {\"min\": %ld, \"p50\": %ld, \"p90\": %ld, \"p99\": %ld, \"max\": %ld, \"mean\": %.0f},\n", 
+        times[0], median, percentile(times, options->repetitions, 0.9), percentile(times, options->repetitions, 0.99), 
+        times[options->repetitions - 1], total / options->repetitions
+    );
+    printf("     \"gflops\": %.3f, \"gbps\": %.3f, \"ns_per_step\": %.1f, \"max_abs_error\": %g, \"peak_rss_kb\": %ld}", 
+        work.flops / seconds * 1e-9, work.bytes / seconds * 1e-9, work.steps > 0 ? (double)median / work.steps : 0.0, 
+        error, peak_rss_kb()
+    );
+    fflush(stdout);
+
+    first_result = 0;
+    fprintf(stderr, "%-12s H=%-4d T=%-4d B=%-4d p50 %10ld ns\n", name, hidden, steps, batch, median);
+
+    SAFE_FREE(times);
+}
+
+typedef struct forward_context{
+    LSTM * lstm;
+    tensor * inputs;
+    int batch;
+} forward_context;
+
+static void run_forward(void * context){
+    forward_context * c = (forward_context *)context;
+    lstm_forward_batch(c->lstm, c->inputs, c->batch);
+}
+
+typedef struct kernel_context{
+    tensor * out;
+    tensor * a;
+    tensor * b;
+} kernel_context;
+
+static void run_mat_mul(void * context){
+    kernel_context * c = (kernel_context *)context;
+    tensor_mat_mul(c->out, c->a, c->b);
+}
+
+static void run_sigmoid(void * context){
+    kernel_context * c = (kernel_context *)context;
+    tensor_sigmoid(c->out, c->a);
+}
+
+static void run_tanh(void * context){
+    kernel_context * c = (kernel_context *)context;
+    tensor_tanh(c->out, c->a);
+}
+
+static void run_concat(void * context){
+    kernel_context * c = (kernel_context *)context;
+    tensor_concat(c->out, c->a, c->b);
+}
+
+/*
+Largest difference between the product on the active backend and the reference loops
+*/
+static double mat_mul_error(kernel_context * c){
+    tensor * expected = tensor_astype(c->out, DTYPE_F64);
+    tensor * actual = tensor_astype(c->out, DTYPE_F64);
+
+    tensor_mat_mul(actual, c->a, c->b);
+
+    const backend_ops * previous = backend_set_current(backend_for(BACKEND_REFERENCE));
+    tensor_mat_mul(expected, c->a, c->b);
+    backend_set_current(previous);
+
+    double error = 0;
+    double * x = tensor_data(expected);
+    double * y = tensor_data(actual);
+    for(int i = 0; i < tensor_shape(actual)[0] * tensor_shape(actual)[1]; i++){
+        double d = x[i] > y[i] ? x[i] - y[i] : y[i] - x[i];
+        error = d > error ? d : error;
+    }
+
+    tensor_cleanup(expected);
+    tensor_cleanup(actual);
+
+    return error;
+}
+
+static void bench_shape(bench_options * options, int features, int hidden, int steps, int batch){
+    int input_size = features + hidden;
+    int output_size = hidden;
+    int flags = options->flags & ~LSTM_INFERENCE;
+
+    LSTM * lstm = lstm_init_with_flags(input_size, hidden, output_size, steps, flags);
+    dtype weight_type = tensor_dtype(lstm->weights->Wy);
+    dtype state_type = tensor_dtype(lstm->cell_states[0]);
+    double weight_size = dtype_size(weight_type);
+    double state_size = dtype_size(state_type);
+
+    int input_shape[2] = {batch * steps, features};
+    forward_context forward = {.lstm = lstm, .inputs = tensor_rand(2, input_shape), .batch = batch};
+
+    // per step: four gate products, the projection and about ten element-wise ops per hidden unit
+    double step_flops = 2.0 * batch * (4.0 * hidden * input_size + (double)output_size * hidden) + 10.0 * hidden * batch;
+    double step_bytes = (4.0 * hidden * input_size + (double)output_size * hidden) * weight_size
+        + (input_size + 6.0 * hidden + output_size) * batch * state_size;
+
+    bench_work work = {.flops = step_flops * steps, .bytes = step_bytes * steps, .steps = steps};
+    bench_run(options, "lstm_forward", hidden, steps, batch, run_forward, &forward, work, 0);
+
+    // the fused gate product of one step
+    int a_shape[2] = {4 * hidden, input_size};
+    int b_shape[2] = {input_size, batch};
+    int c_shape[2] = {4 * hidden, batch};
+
+    kernel_context mat_mul = {
+        .out = tensor_init_with_dtype(2, c_shape, state_type),
+        .a = tensor_astype(tensor_rand(2, a_shape), weight_type),
+        .b = tensor_astype(tensor_rand(2, b_shape), state_type),
+    };
+
+    double m = 4.0 * hidden;
+    work = (bench_work){
+        .flops = 2.0 * m * batch * input_size,
+        .bytes = m * input_size * weight_size + ((double)input_size * batch + m * batch) * state_size,
+    };
+    double error = weight_type == DTYPE_I8 ? 0 : mat_mul_error(&mat_mul);
+    bench_run(options, "mat_mul", hidden, steps, batch, run_mat_mul, &mat_mul, work, error);
+
+    kernel_context activation = {.out = mat_mul.out, .a = mat_mul.out};
+    work = (bench_work){.flops = m * batch, .bytes = 2.0 * m * batch * state_size};
+    bench_run(options, "sigmoid", hidden, steps, batch, run_sigmoid, &activation, work, 0);
+    bench_run(options, "tanh", hidden, steps, batch, run_tanh, &activation, work, 0);
+
+    int h_shape[2] = {hidden, batch};
+    int x_shape[2] = {features, batch};
+    int concat_shape[2] = {input_size, batch};
+
+    kernel_context concat = {
+        .out = tensor_init_with_dtype(2, concat_shape, state_type),
+        .a = tensor_init_with_dtype(2, h_shape, state_type),
+        .b = tensor_init_with_dtype(2, x_shape, state_type),
+    };
+    tensor_fill(concat.a, 0.5);
+    tensor_fill(concat.b, 0.25);
+
+    work = (bench_work){.flops = 0, .bytes = 2.0 * input_size * batch * state_size};
+    bench_run(options, "concat", hidden, steps, batch, run_concat, &concat, work, 0);
+
+    tensor_cleanup(concat.out);
+    tensor_cleanup(concat.a);
+    tensor_cleanup(concat.b);
+    tensor_cleanup(mat_mul.out);
+    tensor_cleanup(mat_mul.a);
+    tensor_cleanup(mat_mul.b);
+    tensor_cleanup(forward.inputs);
+    lstm_cleanup(lstm);
+}
+
+int main(int argc, char ** argv){
+    bench_options options = {.warmup = BENCH_WARMUP, .repetitions = BENCH_REPETITIONS, .flags = LSTM_DEFAULT, .quick = 0};
+
+    int option;
+    while((option = getopt(argc, argv, "w:r:f:q")) != -1){
+        switch(option){
+            case 'w':
+                options.warmup = atoi(optarg);
+                break;
+            case 'r':
+                options.repetitions = atoi(optarg);
+                break;
+            case 'f':
+                options.flags = atoi(optarg);
+                break;
+            case 'q':
+                options.quick = 1;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-w warmup] [-r repetitions] [-f flags] [-q]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    TENSOR_CHECK(options.repetitions < 1, "Repetitions should at least be 1, got %d", options.repetitions);
+
+    int hidden_sizes[] = {64, 128, 256, 512};
+    int sequence_lengths[] = {16, 64};
+    int batch_sizes[] = {1, 8, 32};
+    int features = 64;
+
+    int hidden_count = options.quick ? 2 : ARRAY_LENGTH(hidden_sizes);
+    int length_count = options.quick ? 1 : ARRAY_LENGTH(sequence_lengths);
+    int batch_count = options.quick ? 2 : ARRAY_LENGTH(batch_sizes);
+
+    printf("{\n  \"config\": {\"threads\": %d, \"backend\": \"%s\", \"simd\": \"%s\", \"flags\": %d, \"features\": %d, \"warmup\": %d, \"repetitions\": %d},\n", 
+        thread_pool_threads(), backend_get()->name, simd_get_ops()->name, options.flags, features, options.warmup, options.repetitions
+    );
+    printf("  \"results\": [\n");
+
+    for(int h = 0; h < hidden_count; h++){
+        for(int t = 0; t < length_count; t++){
+            for(int b = 0; b < batch_count; b++){
+                bench_shape(&options, features, hidden_sizes[h], sequence_lengths[t], batch_sizes[b]);
+            }
+        }
+    }
+
+    printf("\n  ],\n  \"peak_rss_kb\": %ld\n}\n", peak_rss_kb());
+
+    thread_pool_shutdown();
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+Bump allocator over one anonymous mapping, nothing is freed until the whole arena goes.
+The mapping is reserved up front and committed page by page as it is touched, hugepage backed
+where the system allows it. When the reservation runs out another block is chained on
+*/
+
+// every allocation starts on its own cache line
+#define ARENA_ALIGNMENT 64
+
+#define ARENA_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+typedef struct arena arena;
+
+/*
+A position in an arena, see arena_rewind
+*/
+typedef struct arena_mark{
+    void * block;
+    size_t offset;
+    size_t used;
+} arena_mark;
+
+/**
+ * @brief Reserves an arena of at least capacity bytes
+ */
+arena * arena_init(size_t capacity);
+
+/**
+ * @brief Returns size bytes aligned to ARENA_ALIGNMENT, never NULL
+ */
+void * arena_alloc(arena * self, size_t size);
+
+/**
+ * @brief Bytes handed out so far, including alignment padding
+ */
+size_t arena_used(arena * self);
+
+/**
+ * @brief Position of the next allocation
+ */
+arena_mark arena_position(arena * self);
+
+/**
+ * @brief Drops every allocation made after mark, blocks chained on since are unmapped
+ *
+ * Pointers into the dropped allocations become invalid, their bytes are handed out again
+ */
+void arena_rewind(arena * self, arena_mark mark);
+
+/**
+ * @brief Whether nothing was allocated between the two positions
+ */
+static inline int arena_mark_equal(arena_mark a, arena_mark b){
+    return a.block == b.block && a.offset == b.offset;
+}
+
+/**
+ * @brief Unmaps every block, all memory from the arena becomes invalid
+ */
+void arena_cleanup(arena * self);
+
+/**
+ * @brief Routes the Data and tensor allocations of the calling thread into self, NULL goes back to the heap
+ *
+ * @return the previously active arena, pass it back in to restore it
+ */
+arena * arena_set_current(arena * self);
+
+/**
+ * @brief Arena active on the calling thread, NULL when allocating from the heap
+ */
+arena * arena_current(void);
+
+#endif // ARENA_H
\ No newline at end of file
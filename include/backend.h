@@ -0,0 +1,67 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include "dtype.h"
+#include "simd.h"
+
+/*
+Kernels the tensor API dispatches to, switchable at runtime for A/B runs.
+LSTM_BACKEND picks the process default (reference, cpu, threaded or pim, default threaded),
+a thread or a model can override it. Kernels a backend leaves out fall back to the next backend in
+pim -> threaded -> cpu -> reference, so every table is complete.
+Int8 products and the fp32 point-wise kernels do not go through the table (see quant.h and simd.h)
+*/
+
+typedef enum backend_kind{
+    // plain loops, the baseline the others are checked against
+    BACKEND_REFERENCE,
+    // cache blocked SIMD kernels on the calling thread
+    BACKEND_CPU,
+    // cpu kernels with large products split across the thread pool
+    BACKEND_THREADED,
+    // products split across emulated banks with their cost modelled, see pim.h
+    BACKEND_PIM,
+} backend_kind;
+
+/*
+c = a * b, or c += a * b when accumulate is set, where element (i, p) of a is a[i * rsa + p * csa],
+(p, j) of b is b[p * rsb + j * csb] and c is row-major
+*/
+typedef void (*backend_mat_mul_op)(int m, int n, int k, const double * a, int rsa, int csa, const double * b, int rsb, int csb, 
+    double * c, int ldc, int accumulate);
+typedef void (*backend_mat_mul_f32_op)(int m, int n, int k, const void * a, dtype a_type, int rsa, int csa, 
+    const void * b, dtype b_type, int rsb, int csb, void * c, dtype c_type, int ldc, int accumulate);
+
+typedef struct backend_ops{
+    backend_kind kind;
+    const char * name;
+
+    backend_mat_mul_op mat_mul;
+    // f32 and bf16 operands, accumulated in fp32
+    backend_mat_mul_f32_op mat_mul_f32;
+
+    simd_unary_op sigmoid;
+    simd_unary_op tanh;
+    simd_unary_op lstm_gates;
+    simd_binary_op add;
+    simd_binary_op mul;
+} backend_ops;
+
+/**
+ * @brief Backend of the calling thread, the process default unless backend_set_current chose another
+ */
+const backend_ops * backend_get(void);
+
+/**
+ * @brief Complete kernel table of a backend
+ */
+const backend_ops * backend_for(backend_kind kind);
+
+/**
+ * @brief Makes the tensor ops of the calling thread dispatch to ops, NULL goes back to the process default
+ *
+ * @return the previous backend of the thread, NULL when it used the default
+ */
+const backend_ops * backend_set_current(const backend_ops * ops);
+
+#endif // BACKEND_H
\ No newline at end of file
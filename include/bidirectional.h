@@ -0,0 +1,46 @@
+#ifndef BIDIRECTIONAL_H
+#define BIDIRECTIONAL_H
+
+#include "lstm.h"
+
+/*
+Two LSTMs with their own weights, one reading the sequence forward and one reading it backward.
+The directions run concurrently on the thread pool and their outputs are concatenated per timestep
+*/
+typedef struct lstm_bidirectional{
+    LSTM * forward;
+    LSTM * backward;
+
+    // the backward direction reads the inputs through a reversed view
+    tensor * reversed;
+    // re-pointed at the rows of the caller output each direction writes
+    tensor * forward_view;
+    tensor * backward_view;
+    tensor * backward_output;
+
+    // the pass currently running
+    tensor * inputs;
+    tensor * outputs;
+    int batch;
+} lstm_bidirectional;
+
+/**
+ * @brief Builds both directions with the sizes and flags of lstm_init_with_flags
+ *
+ * LSTM_INFERENCE is not supported, the backward outputs are only known once the whole sequence is read
+ */
+lstm_bidirectional * lstm_bidirectional_init(int input_size, int hidden_size, int output_size, int sequence_length, int flags);
+
+/**
+ * @brief Runs both directions over batch sequences of exactly sequence_length rows
+ *
+ * @param inputs [batch * sequence_length x features], same layout as lstm_forward_batch
+ * @param batch number of sequences
+ * @param outputs [sequence_length * 2 * output_size x batch] buffer. Rows [2t * output_size, (2t + 1) * output_size)
+ * hold the forward output at step t, the next output_size rows the backward output after reading steps t to the end
+ * @return outputs
+ */
+tensor * lstm_bidirectional_forward(lstm_bidirectional * lstm, tensor * inputs, int batch, tensor * outputs);
+void lstm_bidirectional_cleanup(lstm_bidirectional * lstm);
+
+#endif // BIDIRECTIONAL_H
\ No newline at end of file
@@ -2,10 +2,11 @@
 #define DATA_H
 
 #include "utils.h"
+#include "dtype.h"
 
 typedef struct Data Data;
 
-typedef double * (*allocator)(size_t);
+typedef void * (*allocator)(size_t);
 
 void data_dec(Data * self);
 void data_inc(Data * self);
@@ -16,9 +17,25 @@ void data_free(const struct ref *ref);
  */
 Data * data_init(int size);
 Data * data_init_with_allocator(int size, allocator alloc);
+Data * data_init_with_dtype(int size, dtype type);
+Data * data_init_typed(int size, dtype type, allocator alloc);
+
+/**
+ * @brief Data over memory it does not own, such as a mapped file
+ *
+ * @param ptr size elements of type, never freed by the data
+ * @param owner reference dropped when the data is freed instead of freeing ptr, NULL when ptr outlives the data
+ */
+Data * data_init_external(int size, dtype type, void * ptr, const struct ref * owner);
+
+/*
+Values are passed as double and converted to and from the storage type
+*/
 void data_insert(Data * self, double value, int index);
 void data_memcpy(Data * dest, Data * src, int dest_offset, int src_offset, int length);
 double data_get(Data * self, int index);
-double * data_raw_ptr(Data * self);
-void data_assign_ptr(Data * self, double * ptr);
+void * data_raw_ptr(Data * self);
+void data_assign_ptr(Data * self, void * ptr);
+dtype data_dtype(Data * self);
+int data_size(Data * self);
 #endif // DATA_H
\ No newline at end of file
@@ -0,0 +1,94 @@
+#ifndef DTYPE_H
+#define DTYPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef enum dtype{
+    DTYPE_F64,
+    DTYPE_F32,
+    // upper 16 bits of an IEEE float, computed on in fp32
+    DTYPE_BF16,
+    // quantized integers, the scales live next to the tensor (see quant.h)
+    DTYPE_I8,
+} dtype;
+
+typedef uint16_t bfloat16;
+
+static inline size_t dtype_size(dtype type){
+    switch(type){
+        case DTYPE_F32:
+            return sizeof(float);
+        case DTYPE_BF16:
+            return sizeof(bfloat16);
+        case DTYPE_I8:
+            return sizeof(int8_t);
+        default:
+            return sizeof(double);
+    }
+}
+
+const char * dtype_name(dtype type);
+
+static inline float bf16_to_f32(bfloat16 value){
+    uint32_t bits = (uint32_t)value << 16;
+    float output;
+    memcpy(&output, &bits, sizeof(output));
+    return output;
+}
+
+/*
+Rounds to nearest even, NaNs stay quiet NaNs
+*/
+static inline bfloat16 f32_to_bf16(float value){
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    if((bits & 0x7fffffff) > 0x7f800000){
+        return (bfloat16)((bits >> 16) | 0x40);
+    }
+
+    bits += 0x7fff + ((bits >> 16) & 1);
+    return (bfloat16)(bits >> 16);
+}
+
+static inline double dtype_get(const void * ptr, dtype type, size_t index){
+    switch(type){
+        case DTYPE_F32:
+            return ((const float *)ptr)[index];
+        case DTYPE_BF16:
+            return bf16_to_f32(((const bfloat16 *)ptr)[index]);
+        case DTYPE_I8:
+            return ((const int8_t *)ptr)[index];
+        default:
+            return ((const double *)ptr)[index];
+    }
+}
+
+static inline void dtype_set(void * ptr, dtype type, size_t index, double value){
+    switch(type){
+        case DTYPE_F32:
+            ((float *)ptr)[index] = (float)value;
+            break;
+        case DTYPE_BF16:
+            ((bfloat16 *)ptr)[index] = f32_to_bf16((float)value);
+            break;
+        case DTYPE_I8:
+            value = value > 127 ? 127 : (value < -127 ? -127 : value);
+            ((int8_t *)ptr)[index] = (int8_t)(value < 0 ? value - 0.5 : value + 0.5);
+            break;
+        default:
+            ((double *)ptr)[index] = value;
+    }
+}
+
+/**
+ * @brief Converts length contiguous elements between any two dtypes
+ *
+ * @param src input elements of type src_type
+ * @param dest output elements of type dest_type, may not overlap src unless the types match
+ */
+void dtype_convert(const void * src, dtype src_type, void * dest, dtype dest_type, size_t length);
+
+#endif // DTYPE_H
\ No newline at end of file
@@ -0,0 +1,130 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include "dtype.h"
+
+/*
+Register tile of the micro-kernel, MR rows of a times NR columns of b
+*/
+#define GEMM_MR 4
+#define GEMM_NR 8
+
+/*
+Register tile of the fp32 micro-kernel, a row of NR floats fills one AVX-512 register
+*/
+#define GEMM_MR_F32 4
+#define GEMM_NR_F32 16
+
+/*
+Independent partial sums per row in gemv, lets the dot products vectorize without reassociation
+*/
+#define GEMV_LANES 8
+
+/*
+Cache blocking: a MC x KC block of a stays in L2, a KC x NR sliver of b stays in L1
+*/
+#define GEMM_MC 96
+#define GEMM_KC 256
+#define GEMM_NC 2048
+
+/*
+Below this many multiply-adds packing costs more than it saves
+*/
+#define GEMM_SMALL_FLOPS (16 * 16 * 16)
+
+/*
+From this many multiply-adds on the output rows are split across the thread pool (see thread_pool.h),
+smaller products stay on the calling thread to skip the wake up and join
+*/
+#define GEMM_PARALLEL_FLOPS (64 * 64 * 64)
+
+/*
+Per-thread buffers of the kernels, one per use so nested users never share one
+*/
+typedef enum gemm_scratch_slot{
+    GEMM_SCRATCH_PACKED_A,
+    GEMM_SCRATCH_PACKED_B,
+    // fp32 accumulator of a narrow output
+    GEMM_SCRATCH_OUTPUT,
+    // fp32 copies of a narrow gemv input and output
+    GEMM_SCRATCH_VECTOR_X,
+    GEMM_SCRATCH_VECTOR_Y,
+    // quantized activations and their scales, see quant.h
+    GEMM_SCRATCH_QUANT,
+    GEMM_SCRATCH_QUANT_SCALES,
+    GEMM_SCRATCH_COUNT,
+} gemm_scratch_slot;
+
+/**
+ * @brief At least bytes of the calling thread's buffer for slot, valid until its next call with the same slot
+ *
+ * Buffers only grow and are kept until the thread exits, so products of a steady shape never allocate
+ */
+void * gemm_scratch(gemm_scratch_slot slot, size_t bytes);
+
+/**
+ * @brief c = a * b for row-major matrices
+ *
+ * @param m rows of a and c
+ * @param n columns of b and c
+ * @param k columns of a, rows of b
+ * @param a [m x k] matrix with row stride lda
+ * @param b [k x n] matrix with row stride ldb
+ * @param c [m x n] output with row stride ldc, overwritten
+ */
+void gemm(int m, int n, int k, const double * a, int lda, const double * b, int ldb, double * c, int ldc);
+
+/**
+ * @brief c = a * b where a and b are arbitrary strided views, transposed or broadcast ones included
+ *
+ * The strides are only read while packing, so the kernels run at the same speed for any layout
+ *
+ * @param a element (i, p) is a[i * rsa + p * csa]
+ * @param b element (p, j) is b[p * rsb + j * csb]
+ * @param c [m x n] row-major output with row stride ldc. a and b may share memory, c must not
+ * overlap either
+ * @param accumulate 0 overwrites c, otherwise the product is added to it
+ */
+void gemm_strided(int m, int n, int k, const double * a, int rsa, int csa, const double * b, int rsb, int csb, double * c, int ldc, int accumulate);
+
+/**
+ * @brief gemm_strided on the calling thread only, however large the product
+ */
+void gemm_strided_serial(int m, int n, int k, const double * a, int rsa, int csa, const double * b, int rsb, int csb, double * c, int ldc, int accumulate);
+
+/**
+ * @brief y = a * x for a row-major matrix a and a contiguous vector x
+ *
+ * @param m rows of a and length of y
+ * @param k columns of a and length of x
+ * @param a [m x k] matrix with row stride lda
+ * @param x input vector
+ * @param y output vector, overwritten
+ */
+void gemv(int m, int k, const double * a, int lda, const double * x, double * y);
+
+/**
+ * @brief c = a * b for row-major matrices stored as DTYPE_F32 or DTYPE_BF16, accumulated in fp32
+ *
+ * Narrow operands are widened while packing, a narrow c is rounded once after the full k loop
+ */
+void gemm_f32(int m, int n, int k, const void * a, dtype a_type, int lda, const void * b, dtype b_type, int ldb, void * c, dtype c_type, int ldc);
+
+/**
+ * @brief gemm_f32 on strided operands, adding to c when accumulate is set, see gemm_strided
+ */
+void gemm_f32_strided(int m, int n, int k, const void * a, dtype a_type, int rsa, int csa, const void * b, dtype b_type, int rsb, int csb, 
+    void * c, dtype c_type, int ldc, int accumulate);
+
+/**
+ * @brief gemm_f32_strided on the calling thread only
+ */
+void gemm_f32_strided_serial(int m, int n, int k, const void * a, dtype a_type, int rsa, int csa, const void * b, dtype b_type, int rsb, int csb, 
+    void * c, dtype c_type, int ldc, int accumulate);
+
+/**
+ * @brief y = a * x for DTYPE_F32 or DTYPE_BF16 operands, accumulated in fp32
+ */
+void gemv_f32(int m, int k, const void * a, dtype a_type, int lda, const void * x, dtype x_type, void * y, dtype y_type);
+
+#endif // GEMM_H
\ No newline at end of file
@@ -2,18 +2,63 @@
 #define LSTM_H
 
 #include "tensor.h"
+#include "arena.h"
+#include "backend.h"
 #include <assert.h>
 
 #define _plus tensor_plus
 #define _mul tensor_mul
 #define _mat_mul tensor_mat_mul
 
+enum lstm_flags{
+    LSTM_DEFAULT = 0,
 
+    // store Wf, Wi, Wc and Wo as one contiguous [4 * hidden_size x input_size] block
+    LSTM_FUSED_GATES = 1 << 0,
 
-typedef struct lstm{
-    //hyperparameters
+    // fp32 weights and activations
+    LSTM_FLOAT32 = 1 << 1,
+
+    // bf16 weights with fp32 activations and accumulation
+    LSTM_BFLOAT16 = 1 << 2,
+
+    // int8 weights with per row scales, set by lstm_quantize
+    LSTM_INT8 = 1 << 3,
+
+    // forward only: keeps one h/c pair updated in place instead of the per timestep history, see lstm_infer
+    LSTM_INFERENCE = 1 << 4,
+
+    // training on long sequences: keeps h/c every checkpoint_interval steps, lstm_backward recomputes the rest
+    LSTM_CHECKPOINT = 1 << 5,
+};
+
+/*
+Receives the [output_size x batch] output of every step, the tensor is reused by the next step
+*/
+typedef void (*lstm_output_callback)(int step, tensor * output, void * context);
+
+/*
+Accuracy of the quantized model against the floating point one on the calibration inputs
+*/
+typedef struct lstm_quant_report{
+    double max_abs_error;
+    double mean_abs_error;
+    double max_abs_output;
+} lstm_quant_report;
+
+/*
+Parameters of a model, never written after they are built. Any number of models and sessions on any
+number of threads reference one copy, the last lstm_weights_release frees it
+*/
+typedef struct lstm_weights{
+    int input_size;
     int hidden_size;
-    int sequence_length;
+    int output_size;
+    // LSTM_FUSED_GATES, LSTM_FLOAT32, LSTM_BFLOAT16 and LSTM_INT8 as built
+    int flags;
+
+    //fused gate weights [Wf; Wi; Wc; Wo], only set with LSTM_FUSED_GATES
+    tensor * W;
 
     //forget gate
     tensor * Wf;
@@ -27,23 +72,326 @@ typedef struct lstm{
     //cell state
     tensor * Wc;
 
-    //output
+    //output, NULL for weights built without an output projection
     tensor * Wy;
 
+    // column blocks of the gate weights applied to h_t (W_h) and x_t (W_x). With LSTM_FUSED_GATES only the
+    // first entry is set, views into W covering all four gates, otherwise one view per gate of Wf, Wi, Wc and Wo
+    tensor * Wh[4];
+    tensor * Wx[4];
+
+    struct ref refcount;
+} lstm_weights;
+
+/*
+Scratch for one timestep, the per gate tensors may be views into the fused gates block
+*/
+typedef struct lstm_cell{
+    tensor * concat_input;
+    tensor * gates;
+    tensor * forget_gate;
+    tensor * input_gate;
+    tensor * candidate_gate;
+    tensor * output_gate;
+} lstm_cell;
+
+typedef struct lstm{
+    //hyperparameters
+    int input_size;
+    int hidden_size;
+    int output_size;
+    int sequence_length;
+    int flags;
+
+    // number of sequences the state tensors below hold, one per column
+    int batch_size;
+
+    // owns every tensor of a model from lstm_init_in_arena, NULL otherwise
+    arena * arena;
+    // the state tensors are the last allocations of the arena, rewound to state_start when they are replaced
+    arena_mark state_start;
+    arena_mark state_end;
+
+    // kernels the model runs on, NULL for the backend of the calling thread
+    const backend_ops * backend;
+
+    // shared, the model holds one reference
+    lstm_weights * weights;
+
     // These should be array lists instead of regular arrays
     tensor ** hidden_states;
     tensor ** cell_states;
-    tensor ** concat_inputs;
-    tensor ** forget_gates;
-    tensor ** input_gates;
-    tensor ** candidate_gates;
-    tensor ** output_gates;
+    // scratch of the step being computed, the fused [f; i; c; o] gate activations are not kept per timestep.
+    // The [input_size x batch] concat is only used by lstm_infer, h_0 is a view of its upper rows
+    lstm_cell cell;
+    // view of the input rows of the concat
+    tensor * step_input;
+    // [4 * hidden_size x steps * batch] gates before their activations, step t in columns [t * batch, (t + 1) * batch).
+    // lstm_backward differentiates the activations at these, NULL in inference mode
+    tensor * pre_activations;
+    // buffers of a forward segment, sized like pre_activations and NULL in inference mode: the step major
+    // input rows [steps * batch x features], and h_t and y_t side by side for the output projection
+    tensor * segment_inputs;
+    tensor * segment_hidden;
+    tensor * segment_outputs;
 
     tensor ** outputs;
+    // re-pointed at the current step of a caller provided output buffer
+    tensor * output_view;
+
+    // with LSTM_CHECKPOINT the arrays above hold one segment of checkpoint_interval steps,
+    // h and c at the start of every segment are kept for the recompute in lstm_backward
+    int checkpoint_interval;
+    tensor ** checkpoint_hidden;
+    tensor ** checkpoint_cells;
+    // bumped by every call that rewrites or reallocates the history above
+    unsigned long generation;
+    // view of the inputs of the last lstm_forward_batch, lstm_backward takes x_t from it. The batch, steps and
+    // generation of that pass are kept so lstm_backward can tell when the history no longer belongs to it
+    tensor * inputs;
+    int inputs_batch;
+    int inputs_steps;
+    unsigned long inputs_generation;
 } LSTM;
 
+/*
+Gradients of a loss with respect to the weights and step inputs of the last lstm_forward_batch, in the
+dtype of the activations. Every lstm_backward overwrites them
+*/
+typedef struct lstm_gradients{
+    int sequence_length;
+    int batch_size;
+
+    // [4 * hidden_size x input_size] in the row order [Wf; Wi; Wc; Wo] of the fused block, also for unfused weights
+    tensor * dW;
+    // row block views of dW
+    tensor * dWf;
+    tensor * dWi;
+    tensor * dWc;
+    tensor * dWo;
+    // [output_size x hidden_size]
+    tensor * dWy;
+
+    // [features x sequence_length * batch], the inputs of step t are columns [t * batch, (t + 1) * batch)
+    tensor * d_input;
+    // [features x batch] column block views of d_input, one per step
+    tensor ** d_inputs;
+} lstm_gradients;
+
+/*
+A stream advanced one timestep at a time, h and c carry over between calls.
+The session holds a reference to the weights, so it may outlive the model it was created from
+*/
+typedef struct lstm_session{
+    lstm_weights * weights;
+    // taken from the model, NULL for the backend of the calling thread
+    const backend_ops * backend;
+    int batch_size;
+    // timesteps consumed since init, reset or the restored snapshot
+    long steps;
+
+    // [hidden_size x batch], updated in place. h is a view of the upper rows of the concat
+    tensor * hidden_state;
+    tensor * cell_state;
+    // view of the input rows of the concat
+    tensor * input;
+
+    lstm_cell cell;
+} lstm_session;
+
+/*
+Copy of the recurrent state of a session, restorable into any session of a model with the same sizes
+*/
+typedef struct lstm_snapshot{
+    tensor * hidden_state;
+    tensor * cell_state;
+    long steps;
+} lstm_snapshot;
+
 LSTM * lstm_init(int input_size, int hidden_size, int output_size, int sequence_length);
+LSTM * lstm_init_with_flags(int input_size, int hidden_size, int output_size, int sequence_length, int flags);
+
+/**
+ * @brief Same as lstm_init_with_flags with all weights and state tensors bump allocated from one mapping
+ * 
+ * Tensors and their data are 64 byte aligned and packed next to each other, lstm_cleanup unmaps them at once.
+ * Views or clones of the model tensors must not outlive the model, its weights and sessions over them included.
+ * A batch size or checkpoint interval change rewinds the arena over the old state, so the arena does not grow
+ * with repeated resizes. This needs the state to be the last allocation of the arena, resizing PANICs when the
+ * caller allocated from it since
+ */
+LSTM * lstm_init_in_arena(int input_size, int hidden_size, int output_size, int sequence_length, int flags);
+
+/**
+ * @brief Builds randomly initialized weights holding one reference
+ * 
+ * @param input_size features plus hidden_size, as for lstm_init
+ * @param output_size rows of Wy, 0 leaves out the projection for layers whose h feeds another layer
+ * @param flags LSTM_FUSED_GATES and the storage type, int8 weights come from lstm_quantize
+ */
+lstm_weights * lstm_weights_init(int input_size, int hidden_size, int output_size, int flags);
+
+/**
+ * @brief Builds weights holding one reference over existing tensors, such as loaded ones (see model.h)
+ * 
+ * @param flags LSTM_FUSED_GATES and the storage type the tensors were built with
+ * @param W [4 * hidden_size x input_size] gate block with LSTM_FUSED_GATES, NULL otherwise
+ * @param gates Wf, Wi, Wc and Wo [hidden_size x input_size] without LSTM_FUSED_GATES, NULL otherwise
+ * @param Wy [output_size x hidden_size] projection or NULL
+ * @return the weights, they take ownership of every tensor passed
+ */
+lstm_weights * lstm_weights_from_tensors(int flags, tensor * W, tensor * gates[4], tensor * Wy);
+
+/**
+ * @brief Creates a model with its own activations over existing weights, nothing is copied
+ * 
+ * @param weights shared weights, the model takes a reference
+ * @param sequence_length steps of lstm_forward
+ * @param flags only LSTM_INFERENCE applies, the other flags come from the weights
+ */
+LSTM * lstm_init_with_weights(lstm_weights * weights, int sequence_length, int flags);
+
+/**
+ * @brief Takes a reference to weights, safe from any thread
+ * 
+ * @return weights
+ */
+lstm_weights * lstm_weights_retain(lstm_weights * weights);
+
+/**
+ * @brief Drops a reference to weights, the last one frees them
+ */
+void lstm_weights_release(lstm_weights * weights);
 tensor ** lstm_forward(LSTM * lstm, tensor * input);
+
+/**
+ * @brief Runs batch independent sequences through the lstm at once, turning every gate mat-vec into a GEMM
+ * 
+ * Neither W_x * x_t nor the projection Wy * h_t depend on the recurrence, both run as one GEMM over all
+ * steps (one segment with LSTM_CHECKPOINT), before and after the step loop. A step only multiplies W_h with h_t.
+ * The model keeps a view of inputs for lstm_backward
+ * 
+ * @param lstm the model, its state tensors are resized to [size x batch]
+ * @param inputs [batch * rows x features] tensor, sequence b occupies rows [b * rows, (b + 1) * rows)
+ * @param batch number of sequences
+ * @return sequence_length output tensors of shape [output_size x batch]
+ */
+tensor ** lstm_forward_batch(LSTM * lstm, tensor * inputs, int batch);
+void lstm_set_batch_size(LSTM * lstm, int batch_size);
+
+/**
+ * @brief Switches the model to LSTM_CHECKPOINT with a segment of interval steps
+ * 
+ * Activation memory drops from sequence_length to interval + sequence_length / interval steps of h and c,
+ * lstm_backward pays with a second forward pass over the gates
+ * 
+ * @param interval steps between checkpoints, 0 picks about sqrt(sequence_length)
+ */
+void lstm_set_checkpoint_interval(LSTM * lstm, int interval);
+
+/**
+ * @brief Runs the model and the sessions created from it afterwards on the kernels of one backend
+ * 
+ * Overrides LSTM_BACKEND and backend_set_current for this model only
+ */
+void lstm_set_backend(LSTM * lstm, backend_kind kind);
+
+/**
+ * @brief Runs every row of every sequence through the lstm with O(1) activation memory in the sequence length
+ * 
+ * Works on any lstm, with LSTM_INFERENCE the model never allocates the per timestep history
+ * 
+ * @param lstm the model
+ * @param inputs same layout as lstm_forward_batch, all rows of a sequence are consumed
+ * @param batch number of sequences
+ * @param outputs [rows * output_size x batch] buffer, step t is written to rows [t * output_size, (t + 1) * output_size)
+ */
+void lstm_infer(LSTM * lstm, tensor * inputs, int batch, tensor * outputs);
+
+/**
+ * @brief Same as lstm_infer but hands the output of each step to callback instead of storing it
+ */
+void lstm_infer_callback(LSTM * lstm, tensor * inputs, int batch, lstm_output_callback callback, void * context);
+
+/**
+ * @brief Replaces every weight matrix with its int8 quantization, one f32 scale per output row
+ * 
+ * The quantized matrices are new weights, models and sessions sharing the old ones keep running on them
+ */
+void lstm_quantize(LSTM * lstm);
+
+/**
+ * @brief Quantizes a floating point lstm and reports the output error on the given inputs
+ * 
+ * @param lstm the model, quantized in place
+ * @param inputs calibration inputs, same layout as lstm_forward_batch
+ * @param batch number of sequences in inputs
+ * @return output error of the quantized forward pass against the original one
+ */
+lstm_quant_report lstm_quantize_calibrate(LSTM * lstm, tensor * inputs, int batch);
 void lstm_cleanup(LSTM * this);
 
+/**
+ * @brief Creates gradient buffers for lstm at its current batch size, lstm_backward resizes them when it changes
+ */
+lstm_gradients * lstm_gradients_init(LSTM * lstm);
+
+/**
+ * @brief Backpropagates through the last lstm_forward_batch using the activations it stored
+ * 
+ * The projection and the weight and input gradients of all steps are computed as single GEMMs over
+ * sequence_length * batch columns, only dh = W_h^T * d_gates stays on the serial path through time.
+ * x_t is read back from the inputs of lstm_forward_batch, which must not change in between. With LSTM_CHECKPOINT
+ * the steps are processed one segment at a time, the gates of a segment are recomputed from its checkpoint.
+ * The activations are differentiated as the rational approximations the forward pass evaluates,
+ * at the gate pre-activations it keeps in pre_activations. Panics when lstm_infer, lstm_set_batch_size or
+ * any other call rewrote that history after the forward pass
+ * 
+ * @param lstm a floating point model without LSTM_INFERENCE
+ * @param output_gradients sequence_length [output_size x batch] tensors, dL/d of the outputs of lstm_forward_batch
+ * @param gradients receives dW, dWy and the step input gradients, see lstm_gradients
+ */
+void lstm_backward(LSTM * lstm, tensor ** output_gradients, lstm_gradients * gradients);
+void lstm_gradients_cleanup(lstm_gradients * gradients);
+
+/**
+ * @brief Creates a stream over the weights of lstm starting from the zero state
+ * 
+ * @param lstm the model, the session references its weights and keeps no pointer to the model
+ * @param batch_size number of independent streams, one column each
+ */
+lstm_session * lstm_session_init(LSTM * lstm, int batch_size);
+
+/**
+ * @brief Creates a stream over shared weights, see lstm_session_init
+ */
+lstm_session * lstm_session_init_with_weights(lstm_weights * weights, int batch_size);
+
+/**
+ * @brief Advances the session by one timestep
+ * 
+ * @param session the stream, its h and c are updated in place
+ * @param input [features x batch] input of this timestep
+ * @param output [output_size x batch] tensor receiving the output, NULL when the weights have no projection
+ * @return output
+ */
+tensor * lstm_step(lstm_session * session, tensor * input, tensor * output);
+
+/**
+ * @brief Sets h and c back to zero
+ */
+void lstm_session_reset(lstm_session * session);
+
+/**
+ * @brief Copies h and c of the session, the session keeps running independently
+ */
+lstm_snapshot * lstm_session_snapshot(lstm_session * session);
+
+/**
+ * @brief Overwrites h and c of the session with a snapshot, restoring into a new session forks the stream
+ */
+void lstm_session_restore(lstm_session * session, lstm_snapshot * snapshot);
+void lstm_snapshot_cleanup(lstm_snapshot * snapshot);
+void lstm_session_cleanup(lstm_session * session);
+
 #endif // LSTM_H
\ No newline at end of file
@@ -16,6 +16,25 @@ static inline void vector_tanh(double * a, int length){
     }
 }
 
+/*
+Applies the lstm gate activations to a fused [f; i; c; o] block of length elements in one pass
+*/
+static inline void vector_lstm_gates(double * a, int length){
+    int slice = length / 4;
+
+    double * f = a;
+    double * i = a + slice;
+    double * c = a + 2 * slice;
+    double * o = a + 3 * slice;
+
+    for(int j = 0; j < slice; j++){
+        f[j] = sigmoid(f[j]);
+        i[j] = sigmoid(i[j]);
+        c[j] = tanh(c[j]);
+        o[j] = sigmoid(o[j]);
+    }
+}
+
 static inline double vector_dot_product(const double * a, const double * b, unsigned int length){
     double output = 0;
     for(size_t i = 0; i < length; i++){
@@ -0,0 +1,91 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+#include <stdint.h>
+
+#include "lstm.h"
+
+/*
+Versioned binary model file: one fixed size header, then every weight blob at a 64 byte aligned offset.
+The header records the sizes, the weight flags and for every blob its dtype, shape, offset and a CRC-32,
+the header itself ends with the CRC-32 of the bytes before it. Fields are stored in host byte order,
+on a host of the other endianness the version reads back byte swapped and the file is rejected.
+
+Blob order: W (or Wf, Wi, Wc, Wo without LSTM_FUSED_GATES), then Wy when present.
+An int8 matrix is followed by its [rows x 1] f32 scales.
+
+lstm_load_mmap maps the file read-only and the weight tensors point straight into the mapping, so
+loading costs the same for any model size and every process loading a file shares its page cache copy.
+Blob checksums are not read on load, since that would touch every page, lstm_model_verify checks them.
+*/
+
+#define LSTM_MODEL_MAGIC "LSTMMDL"
+#define LSTM_MODEL_VERSION 1
+// cache line and AVX-512 register width
+#define LSTM_MODEL_ALIGNMENT 64
+// four gates and the projection, each with its scales
+#define LSTM_MODEL_MAX_BLOBS 10
+
+typedef struct lstm_model_blob{
+    uint64_t offset;
+    uint64_t bytes;
+    uint32_t dtype;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t checksum;
+} lstm_model_blob;
+
+typedef struct lstm_model_header{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_bytes;
+    uint64_t file_bytes;
+
+    // lstm_weights fields
+    uint32_t input_size;
+    uint32_t hidden_size;
+    uint32_t output_size;
+    uint32_t flags;
+
+    uint32_t blob_count;
+    uint32_t reserved;
+    lstm_model_blob blobs[LSTM_MODEL_MAX_BLOBS];
+
+    // CRC-32 of every byte above
+    uint32_t checksum;
+    uint32_t padding;
+} lstm_model_header;
+
+/**
+ * @brief Writes weights to path in the model format, replacing any existing file
+ */
+void lstm_weights_save(lstm_weights * weights, const char * path);
+
+/**
+ * @brief Writes the weights of a model to path, activations and batch size are not saved
+ */
+void lstm_save(LSTM * lstm, const char * path);
+
+/**
+ * @brief Maps a model file read-only as weights holding one reference
+ *
+ * The mapping stays until the last tensor over it is freed, PANICs on a malformed header
+ */
+lstm_weights * lstm_weights_load_mmap(const char * path);
+
+/**
+ * @brief Creates a model over the mapped weights of path, see lstm_init_with_weights
+ *
+ * @param sequence_length steps of lstm_forward
+ * @param flags only LSTM_INFERENCE applies, the other flags come from the file
+ */
+LSTM * lstm_load_mmap(const char * path, int sequence_length, int flags);
+
+/**
+ * @brief Checks the header and every blob checksum of a model file
+ *
+ * @return 1 when the file is intact, 0 after printing the first mismatch to stderr
+ */
+int lstm_model_verify(const char * path);
+
+#endif // MODEL_H
\ No newline at end of file
@@ -0,0 +1,156 @@
+#ifndef PIM_H
+#define PIM_H
+
+#include "lstm.h"
+
+/*
+Host side emulator of an UPMEM style processing-in-memory system running an LSTM weight stationary.
+
+The hidden units are split into contiguous ranges, one per bank (DPU). A bank keeps the [Wf; Wi; Wc; Wo]
+rows of its units in MRAM and its slice of c in WRAM. Every step the host broadcasts [h_t; x_t] to all banks,
+each bank computes its gates, c and h_{t+1}, and the host gathers h_{t+1} and applies Wy.
+The arithmetic runs on the host, times and transfers are modelled from the config
+*/
+
+/*
+Rough figures of an UPMEM DPU, tune them to measurements
+*/
+#define PIM_MRAM_BYTES ((size_t)64 << 20)
+#define PIM_WRAM_BYTES ((size_t)64 << 10)
+#define PIM_FREQUENCY_MHZ 350.0
+// floats are emulated in software on the 32 bit DPU pipeline
+#define PIM_CYCLES_PER_MAC 32.0
+#define PIM_CYCLES_PER_ACTIVATION 96.0
+#define PIM_MRAM_GBPS 0.6
+#define PIM_HOST_TO_BANK_GBPS 6.0
+#define PIM_BANK_TO_HOST_GBPS 4.5
+
+/*
+Banks the pim backend (see backend.h) splits every product over, LSTM_PIM_BANKS overrides it
+*/
+#define PIM_BACKEND_BANKS 64
+
+typedef struct pim_config{
+    int banks;
+    // capacity per bank
+    size_t mram_bytes;
+    size_t wram_bytes;
+
+    double frequency_mhz;
+    double cycles_per_mac;
+    double cycles_per_activation;
+    // MRAM to WRAM bandwidth of one bank
+    double mram_gbps;
+    // aggregate host link bandwidths
+    double host_to_bank_gbps;
+    double bank_to_host_gbps;
+} pim_config;
+
+typedef struct pim_bank{
+    // hidden units [first_unit, first_unit + units)
+    int first_unit;
+    int units;
+
+    // MRAM: [f; i; c; o] rows of the units of the bank, [4 * units x input_size]
+    tensor * weights;
+
+    // WRAM: gate block with per gate views, c stays resident, h is gathered after every step
+    tensor * gates;
+    tensor * forget_gate;
+    tensor * input_gate;
+    tensor * candidate_gate;
+    tensor * output_gate;
+    tensor * cell_state;
+    tensor * hidden_state;
+
+    size_t mram_used;
+    size_t wram_used;
+
+    // modelled time and multiply-adds over all steps
+    double seconds;
+    long macs;
+} pim_bank;
+
+typedef struct pim_report{
+    int banks;
+    long steps;
+
+    // weights written to MRAM once, activations moved every step
+    size_t weight_bytes;
+    size_t broadcast_bytes;
+    size_t gather_bytes;
+    double transfer_seconds;
+
+    // modelled compute time per bank, owned by the emulator
+    const double * bank_seconds;
+    double max_bank_seconds;
+    double mean_bank_seconds;
+    // max over mean bank time, 1 is perfectly balanced
+    double imbalance;
+
+    // transfers plus the slowest bank of every step
+    double total_seconds;
+} pim_report;
+
+typedef struct pim_lstm{
+    pim_config config;
+    lstm_weights * weights;
+    int batch_size;
+
+    pim_bank * banks;
+    double * bank_seconds;
+
+    // host copy of [h; x] broadcast to the banks, h is gathered into its upper rows
+    tensor * concat;
+    tensor * hidden_state;
+    tensor * input;
+    tensor * gather_view;
+    tensor * output_view;
+
+    pim_report report;
+} pim_lstm;
+
+/**
+ * @brief Default UPMEM figures for the given number of banks
+ */
+pim_config pim_config_default(int banks);
+
+/**
+ * @brief Partitions the weights across the banks of config and loads them into the emulated MRAM
+ *
+ * Panics when a bank runs out of MRAM or when there are more banks than hidden units
+ *
+ * @param weights floating point weights with an output projection, the emulator takes a reference
+ * @param config bank count, capacities and the timing model
+ */
+pim_lstm * pim_lstm_init(lstm_weights * weights, pim_config config);
+
+/**
+ * @brief Same as lstm_infer on the emulated banks, the modelled costs add up in the report
+ *
+ * Panics when the working set of a bank for this batch does not fit its WRAM
+ */
+void pim_lstm_infer(pim_lstm * pim, tensor * inputs, int batch, tensor * outputs);
+
+/**
+ * @brief Modelled transfers and times of every step run so far
+ */
+pim_report pim_lstm_report(pim_lstm * pim);
+void pim_report_printf(pim_report * report);
+void pim_lstm_cleanup(pim_lstm * pim);
+
+/**
+ * @brief Product of the pim backend: the rows of a are split across the banks, b is broadcast and c gathered
+ *
+ * Nothing stays resident between calls, so a is streamed from MRAM every time. See gemm_strided for the layout
+ */
+void pim_mat_mul(int m, int n, int k, const double * a, int rsa, int csa, const double * b, int rsb, int csb, double * c, int ldc, int accumulate);
+
+/**
+ * @brief Modelled costs of every pim_mat_mul so far, summed over all threads
+ *
+ * The bank times are the slowest and the mean bank of each product summed, bank_seconds is NULL
+ */
+pim_report pim_backend_report(void);
+
+#endif // PIM_H
\ No newline at end of file
@@ -0,0 +1,106 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/*
+Counters around the public tensor ops and the phases of an lstm step, compiled in with -DLSTM_PROFILE
+(make PROFILE=1 after a make clean). Without it PROFILE_BEGIN and PROFILE_END expand to nothing and
+their flop and byte expressions are never evaluated.
+
+Every thread accumulates calls, cycles, nanoseconds, flops and bytes into its own table, the tables are
+summed into a report on stderr at exit. Setting LSTM_PROFILE_TRACE to a path also records every event and
+writes them as Chrome trace JSON (chrome://tracing, Perfetto) next to the report.
+Times are inclusive, an lstm phase counts the tensor ops it calls as well
+*/
+
+typedef enum profile_event{
+    PROFILE_TENSOR_MAT_MUL,
+    PROFILE_TENSOR_MAT_MUL_GATES,
+    PROFILE_TENSOR_PLUS,
+    PROFILE_TENSOR_MUL,
+    PROFILE_TENSOR_SIGMOID,
+    PROFILE_TENSOR_TANH,
+    PROFILE_TENSOR_GATE_ACTIVATIONS,
+    PROFILE_TENSOR_CONCAT,
+    PROFILE_TENSOR_SELECT_BATCH,
+    PROFILE_TENSOR_CONVERT,
+    PROFILE_TENSOR_LSTM_CELL_BACKWARD,
+
+    // the gather of x_t next to h_{t-1}, the concat of the reference lstm, or of the inputs of a whole segment
+    PROFILE_LSTM_CONCAT,
+    // W_x * X of every step of a segment, hoisted out of the step loop of lstm_forward_batch
+    PROFILE_LSTM_INPUT_PROJECTION,
+    // fused [4H x I] mat-vec with its activations, or W_h * h_t added to the hoisted W_x * x_t
+    PROFILE_LSTM_GATES,
+    PROFILE_LSTM_FORGET_GATE,
+    PROFILE_LSTM_INPUT_GATE,
+    PROFILE_LSTM_CANDIDATE_GATE,
+    PROFILE_LSTM_OUTPUT_GATE,
+    PROFILE_LSTM_CELL_UPDATE,
+    PROFILE_LSTM_PROJECTION,
+
+    PROFILE_EVENT_COUNT,
+} profile_event;
+
+/*
+Flops per element of the rational activations in utils.h, sigmoid on three quarters of a gate block and tanh on the rest
+*/
+#define PROFILE_SIGMOID_FLOPS 8
+#define PROFILE_TANH_FLOPS 13
+#define PROFILE_GATE_FLOPS ((3 * PROFILE_SIGMOID_FLOPS + PROFILE_TANH_FLOPS) / 4.0)
+
+#ifdef LSTM_PROFILE
+
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILE_CYCLES() __rdtsc()
+#else
+#define PROFILE_CYCLES() 0ULL
+#endif
+
+typedef struct profile_scope{
+    profile_event event;
+    long long start_ns;
+    unsigned long long start_cycles;
+} profile_scope;
+
+static inline long long profile_now_ns(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static inline profile_scope profile_begin(profile_event event){
+    return (profile_scope){event, profile_now_ns(), PROFILE_CYCLES()};
+}
+
+/**
+ * @brief Closes a scope opened by profile_begin and adds it to the table of the calling thread
+ *
+ * @param flops floating point operations done inside the scope
+ * @param bytes bytes read and written inside the scope
+ */
+void profile_end(const profile_scope * scope, double flops, double bytes);
+
+/**
+ * @brief Writes the summed tables to stderr and the trace to LSTM_PROFILE_TRACE, runs at exit on its own
+ */
+void profile_dump(void);
+
+/**
+ * @brief Zeroes the counters and drops the recorded trace of every thread
+ */
+void profile_reset(void);
+
+#define PROFILE_BEGIN(event) profile_scope profile_scope_##event = profile_begin(event)
+#define PROFILE_END(event, flops, bytes) profile_end(&profile_scope_##event, (double)(flops), (double)(bytes))
+
+#else
+
+#define PROFILE_BEGIN(event)
+#define PROFILE_END(event, flops, bytes)
+
+#endif // LSTM_PROFILE
+
+#endif // PROFILE_H
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef QUANT_H
+#define QUANT_H
+
+#include <stdint.h>
+
+#include "dtype.h"
+
+/*
+Symmetric int8 quantization: value = q * scale with q in [-127, 127]. Weights carry one scale per
+output row, activations are quantized on the fly with one scale per column.
+*/
+
+typedef enum quant_epilogue{
+    QUANT_EPILOGUE_NONE,
+    // sigmoid, sigmoid, tanh, sigmoid over the four equal row blocks of a fused gate output
+    QUANT_EPILOGUE_LSTM_GATES,
+    // adds the product to c instead of overwriting it
+    QUANT_EPILOGUE_ACCUMULATE,
+} quant_epilogue;
+
+/**
+ * @brief Quantizes every row of a [rows x cols] matrix with its own scale
+ *
+ * @param src row-major input of type src_type
+ * @param q int8 output, same layout
+ * @param scales output, one float per row
+ */
+void quantize_rows(const void * src, dtype src_type, int rows, int cols, int8_t * q, float * scales);
+
+/**
+ * @brief c = a * b with int8 weights, int8 activations and int32 accumulation
+ *
+ * b is quantized per column on entry. The int32 sums are dequantized with a_scale[i] * b_scale[j]
+ * and passed through the epilogue in registers before the single store to c
+ *
+ * @param a [m x k] int8 weights with row stride lda
+ * @param a_scale per row scales of a
+ * @param b [k x n] activations of type b_type with row stride ldb
+ * @param c [m x n] output of type c_type (f64 or f32) with row stride ldc
+ */
+void quant_gemm(int m, int n, int k, const int8_t * a, int lda, const float * a_scale, 
+    const void * b, dtype b_type, int ldb, void * c, dtype c_type, int ldc, quant_epilogue epilogue);
+
+#endif // QUANT_H
\ No newline at end of file
@@ -0,0 +1,79 @@
+#ifndef READER_H
+#define READER_H
+
+#include "lstm.h"
+
+/*
+Streams a sequence from a file into lstm_step without materializing it.
+A background thread fills one chunk of timesteps while the step loop consumes the other, so reads,
+parsing and page faults overlap with compute and memory stays at two chunks for any file size.
+
+The file holds rows of features values, timestep major: with a batch of B the rows t * B to t * B + B - 1
+are the B sequences at timestep t. Binary files are raw row-major f32 or f64 values without a header,
+CSV files have one row per line.
+*/
+
+/*
+Timesteps per chunk when the config leaves it at 0
+*/
+#define LSTM_READER_CHUNK_STEPS 1024
+
+typedef enum lstm_reader_format{
+    // raw elements of the config dtype, read in chunks
+    LSTM_READER_BINARY,
+    // raw elements mapped read-only, chunks are views into the mapping
+    LSTM_READER_MMAP,
+    // comma separated values, parsed into chunks of the config dtype
+    LSTM_READER_CSV,
+} lstm_reader_format;
+
+typedef struct lstm_reader_config{
+    lstm_reader_format format;
+    int features;
+    int batch_size;
+    int chunk_steps;
+    // element type of binary files and of the parsed CSV chunks, DTYPE_F32 or DTYPE_F64
+    dtype type;
+} lstm_reader_config;
+
+typedef struct lstm_reader lstm_reader;
+
+/**
+ * @brief Config of a binary f64 file with one sequence
+ */
+lstm_reader_config lstm_reader_config_default(int features);
+
+/**
+ * @brief Opens path and starts prefetching its first chunk
+ */
+lstm_reader * lstm_reader_open(const char * path, lstm_reader_config config);
+
+/**
+ * @brief Waits for the next timestep if it is still being read
+ *
+ * @return [features x batch] view of the timestep, valid until the next call. NULL at the end of the file
+ */
+tensor * lstm_reader_next(lstm_reader * reader);
+
+/**
+ * @brief Timesteps returned so far
+ */
+long lstm_reader_steps(lstm_reader * reader);
+
+/**
+ * @brief Runs every remaining timestep of reader through session
+ *
+ * @param session a session with the batch size of the reader
+ * @param callback called with the [output_size x batch] output of every step (h when the weights have no
+ * projection), the tensor is reused by the next step. May be NULL
+ * @param context passed through to callback
+ * @return number of steps run
+ */
+long lstm_reader_run(lstm_reader * reader, lstm_session * session, lstm_output_callback callback, void * context);
+
+/**
+ * @brief Stops the prefetch thread and closes the file
+ */
+void lstm_reader_close(lstm_reader * reader);
+
+#endif // READER_H
\ No newline at end of file
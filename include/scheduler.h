@@ -0,0 +1,65 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "lstm.h"
+
+/*
+Runs independent sequences against one model on a set of worker threads.
+Every worker owns an lstm_session, so the only shared state is the read-only weights.
+Jobs are pushed round robin onto per-worker deques: owners pop their newest job,
+idle workers steal the oldest job of another worker, which keeps variable length jobs balanced
+*/
+
+typedef struct lstm_scheduler lstm_scheduler;
+typedef struct lstm_job lstm_job;
+
+/*
+Called on the worker thread once all outputs of the job are written. The job already counts as done, so
+lstm_job_wait may return while the callback runs and the callback may free the job with lstm_job_cleanup.
+A job with a callback is freed either by the callback or after lstm_scheduler_wait_all, which waits for the callbacks
+*/
+typedef void (*lstm_job_callback)(lstm_job * job, tensor * outputs, void * context);
+
+/**
+ * @brief Starts worker threads running sequences through lstm
+ *
+ * @param lstm the model, it is only read and has to outlive the scheduler
+ * @param workers number of worker threads, 0 for the number of online cpus
+ */
+lstm_scheduler * lstm_scheduler_init(LSTM * lstm, int workers);
+
+/**
+ * @brief Queues one sequence, returns immediately
+ *
+ * @param scheduler the scheduler
+ * @param inputs [rows x features] sequence, any length. It is referenced, not copied
+ * @param callback optional, called on the worker when the job is done
+ * @param context passed through to callback
+ * @return a future for the outputs, free it with lstm_job_cleanup
+ */
+lstm_job * lstm_scheduler_submit(lstm_scheduler * scheduler, tensor * inputs, lstm_job_callback callback, void * context);
+
+/**
+ * @brief Blocks until the job is done
+ *
+ * @return [rows x output_size] outputs of the job, row t is the output of step t. Owned by the job
+ */
+tensor * lstm_job_wait(lstm_job * job);
+
+/**
+ * @brief Whether the outputs of the job are ready, never blocks
+ */
+int lstm_job_done(lstm_job * job);
+void lstm_job_cleanup(lstm_job * job);
+
+/**
+ * @brief Blocks until every submitted job is done
+ */
+void lstm_scheduler_wait_all(lstm_scheduler * scheduler);
+
+/**
+ * @brief Finishes the queued jobs and joins the workers
+ */
+void lstm_scheduler_cleanup(lstm_scheduler * scheduler);
+
+#endif // SCHEDULER_H
\ No newline at end of file
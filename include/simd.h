@@ -0,0 +1,72 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+/*
+Vector kernels selected once at startup from the instruction sets the cpu reports.
+Setting LSTM_SIMD to scalar, sse2, avx2 or avx512 forces a lower level for A/B runs.
+*/
+
+#if defined(__x86_64__) && defined(__ELF__) && defined(__GNUC__)
+#define SIMD_X86 1
+// compiles one copy of a function per isa and picks the best at load time through an ifunc
+#define SIMD_TARGET_CLONES __attribute__((target_clones("avx512f", "avx2,fma", "default")))
+#else
+#define SIMD_X86 0
+#define SIMD_TARGET_CLONES
+#endif
+
+typedef enum simd_isa{
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2,
+    SIMD_AVX512,
+} simd_isa;
+
+typedef void (*simd_unary_op)(const double * a, double * c, unsigned int length);
+typedef void (*simd_binary_op)(const double * a, const double * b, double * c, unsigned int length);
+
+typedef struct simd_ops{
+    simd_isa isa;
+    const char * name;
+
+    simd_unary_op sigmoid;
+    simd_unary_op tanh;
+    // sigmoid, sigmoid, tanh, sigmoid over the four equal slices of a fused gate block
+    simd_unary_op lstm_gates;
+
+    simd_binary_op add;
+    simd_binary_op mul;
+} simd_ops;
+
+/**
+ * Kernels for the best isa supported by this cpu, resolved once at startup
+ */
+const simd_ops * simd_get_ops(void);
+
+/**
+ * Kernels for a specific isa, NULL if the cpu or the build does not support it
+ */
+const simd_ops * simd_ops_for(simd_isa isa);
+
+/*
+fp32 kernels with the same signatures. They are plain loops the compiler vectorizes once per isa
+through SIMD_TARGET_CLONES, so LSTM_SIMD does not apply to them
+*/
+void simd_sigmoid_f32(const float * a, float * c, unsigned int length);
+void simd_tanh_f32(const float * a, float * c, unsigned int length);
+void simd_lstm_gates_f32(const float * a, float * c, unsigned int length);
+void simd_add_f32(const float * a, const float * b, float * c, unsigned int length);
+void simd_mul_f32(const float * a, const float * b, float * c, unsigned int length);
+
+/*
+Backward of one lstm cell step through its activations, every array holds length = hidden * batch elements.
+pre_gates are the f, i, g and o pre-activations of the step, c_prev and c the cell state before and after it.
+dc holds dL/dc of the step on entry and dL/dc of the previous step on return,
+d_gates receive dL/d of the four pre-activations
+*/
+void simd_lstm_cell_backward(const double * const pre_gates[4], const double * c_prev, const double * c, const double * dh, 
+    double * dc, double * const d_gates[4], unsigned int length);
+void simd_lstm_cell_backward_f32(const float * const pre_gates[4], const float * c_prev, const float * c, const float * dh, 
+    float * dc, float * const d_gates[4], unsigned int length);
+
+#endif // SIMD_H
\ No newline at end of file
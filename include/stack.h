@@ -0,0 +1,82 @@
+#ifndef STACK_H
+#define STACK_H
+
+#include <pthread.h>
+
+#include "lstm.h"
+
+/*
+Hidden states a layer may run ahead of the layer consuming them
+*/
+#define LSTM_STACK_RING 4
+
+/*
+Scans over the layers an idle worker makes before it parks until some layer steps
+*/
+#define LSTM_STACK_SPINS 64
+
+/*
+Layers of LSTMs where h of layer l is the input of layer l + 1, only the last layer projects through Wy.
+
+Runs as a wavefront: cell (l, t) only waits for (l - 1, t) and for layer l + 1 to free a ring slot,
+so (l, t) and (l + 1, t - 1) run on different threads and a pass takes about layers + rows steps
+on the critical path instead of layers * rows
+*/
+typedef struct lstm_stack{
+    int layers;
+    int features;
+    int hidden_size;
+    int output_size;
+    int flags;
+    int batch_size;
+
+    // layer l takes features (l == 0) or hidden_size inputs
+    lstm_weights ** weights;
+    // per layer h and c, rebuilt when the batch size changes
+    lstm_session ** sessions;
+
+    // LSTM_STACK_RING [hidden_size x batch] slots per layer but the last, step t of layer l goes to slot t % LSTM_STACK_RING
+    tensor ** ring;
+    // [features x batch] input of the first layer and the step view of the caller output
+    tensor * input;
+    tensor * output_view;
+
+    // steps done per layer, a layer runs on one thread at a time
+    atomic_int * progress;
+    atomic_int * busy;
+    atomic_int finished;
+
+    // bumped after every step and every released layer, idle workers sleep on wake until it moves
+    atomic_int changes;
+    atomic_int sleepers;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+
+    // the pass currently running
+    tensor * inputs;
+    tensor * outputs;
+    int rows;
+} lstm_stack;
+
+/**
+ * @brief Builds a stack of layers with random weights
+ *
+ * @param layers number of layers, at least 1
+ * @param features input features of the first layer
+ * @param hidden_size hidden units of every layer
+ * @param output_size rows of the projection of the last layer
+ * @param flags LSTM_FUSED_GATES and the storage type, as for lstm_init_with_flags
+ */
+lstm_stack * lstm_stack_init(int layers, int features, int hidden_size, int output_size, int flags);
+
+/**
+ * @brief Runs every row of every sequence through all layers, spreading the layers over the thread pool
+ *
+ * @param inputs [batch * rows x features], same layout as lstm_infer
+ * @param batch number of sequences
+ * @param outputs [rows * output_size x batch] outputs of the last layer, same layout as lstm_infer
+ */
+void lstm_stack_infer(lstm_stack * stack, tensor * inputs, int batch, tensor * outputs);
+void lstm_stack_cleanup(lstm_stack * stack);
+
+#endif // STACK_H
\ No newline at end of file
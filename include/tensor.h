@@ -15,10 +15,59 @@
 typedef struct tensor tensor;
 
 tensor * tensor_init(int ndims, int shape[MAX_DIM]);
+tensor * tensor_init_with_dtype(int ndims, int shape[MAX_DIM], dtype type);
+
+/**
+ * @brief Creates a contiguous tensor over existing data, the tensor takes its own reference
+ *
+ * @param data storage holding at least offset plus the length of shape elements
+ * @param offset element offset of the first element in data
+ */
+tensor * tensor_init_from_data(int ndims, int shape[MAX_DIM], Data * data, int offset);
 tensor * _tensor_zeros(int ndims, int shape[MAX_DIM]);
 tensor * _tensor_ones(int ndims, int shape[MAX_DIM]);
 tensor * tensor_rand(int ndims, int shape[MAX_DIM]);
 
+/*
+Fill every element of self, converting to its dtype
+*/
+tensor * tensor_fill(tensor * self, double value);
+tensor * tensor_fill_rand(tensor * self);
+
+/**
+ * @brief Copies src into self, converting between their dtypes
+ * 
+ * @param self output tensor with the same length as src
+ * @param src input tensor
+ * @return self
+ */
+tensor * tensor_convert(tensor * self, tensor * src);
+
+/**
+ * @brief Creates a new tensor holding src converted to type
+ */
+tensor * tensor_astype(tensor * src, dtype type);
+
+/**
+ * @brief Creates a new DTYPE_I8 tensor holding src quantized with one scale per row
+ * 
+ * @param src input matrix of any floating point dtype
+ * @return the quantized tensor, its scales are available through tensor_scale
+ */
+tensor * tensor_quantize(tensor * src);
+
+/**
+ * Get the [rows x 1] f32 scales of a quantized tensor, NULL for other dtypes
+ */
+tensor * tensor_scale(tensor * self);
+
+/**
+ * @brief Attaches the [rows x 1] f32 scales of a DTYPE_I8 tensor, self takes ownership of scale
+ *
+ * @return self
+ */
+tensor * tensor_set_scale(tensor * self, tensor * scale);
+
 /**
  * @brief Concat two tensors t1 and t2, returning the results to self
  * 
@@ -86,6 +135,84 @@ tensor * tensor_mul(tensor * self, tensor * t1, tensor * t2);
  */
 tensor * tensor_select(tensor * self, tensor * src, int index);
 
+/**
+ * @brief Gathers rows index, index + stride, ... of src into the columns of self
+ * 
+ * @param self [features x batch] output tensor
+ * @param src input tensor with features columns
+ * @param index row of the first sequence
+ * @param stride rows between consecutive sequences
+ * @return self
+ */
+tensor * tensor_select_batch(tensor * self, tensor * src, int index, int stride);
+
+/**
+ * @brief Turns self into a view of length rows (axis 0) or columns (axis 1) of src starting at start, sharing the data of src
+ * 
+ * @param self output tensor
+ * @param src input tensor
+ * @param axis axis to slice along
+ * @param start first row or column of the view
+ * @param length number of rows or columns in the view
+ * @return self
+ */
+tensor * tensor_slice(tensor * self, tensor * src, int axis, int start, int length);
+
+/**
+ * @brief Turns self into the transposed view of the matrix src, no data is moved
+ * 
+ * @param self output tensor
+ * @param src input matrix, quantized matrices are not supported
+ * @return self
+ */
+tensor * tensor_transpose(tensor * self, tensor * src);
+
+/**
+ * @brief Turns self into a view of src repeated size times along an axis of length 1, the repeats share memory
+ * 
+ * @param self output tensor
+ * @param src input tensor with shape 1 along axis
+ * @param axis axis to broadcast along
+ * @param size length of the broadcast axis
+ * @return self
+ */
+tensor * tensor_broadcast(tensor * self, tensor * src, int axis, int size);
+
+/**
+ * @brief Turns self into a view of src with the order along axis reversed, no data is moved
+ * 
+ * @param self output tensor
+ * @param src input tensor
+ * @param axis axis to reverse
+ * @return self
+ */
+tensor * tensor_reverse(tensor * self, tensor * src, int axis);
+
+/**
+ * @brief Whether the elements of self are laid out densely in row-major order
+ * 
+ * Every kernel has a fast path for contiguous operands, strided views are gathered or packed instead
+ */
+int tensor_is_contiguous(tensor * self);
+
+/**
+ * @brief Creates a new contiguous tensor with the elements of src, a view if src already is contiguous
+ */
+tensor * tensor_contiguous(tensor * src);
+
+/**
+ * Get the element strides of both axes, element (i, j) lives at tensor_raw_data + i * strides[0] + j * strides[1]
+ */
+int * tensor_strides(tensor * self);
+
+/**
+ * @brief Creates a new tensor header with shallow reference to the data of src
+ * 
+ * @param src input tensor
+ * @return the new view
+ */
+tensor * tensor_view(tensor * src);
+
 /**
  * @brief multiply two tensors t1 and t2, returning the results to self
  * 
@@ -96,6 +223,28 @@ tensor * tensor_select(tensor * self, tensor * src, int index);
  */
 tensor * tensor_mat_mul(tensor * self, tensor * t1, tensor * t2);
 
+/**
+ * @brief adds the product of t1 and t2 to self, the kernels add while storing so no temporary is formed
+ * 
+ * @param self output tensor holding the addend
+ * @param t1 input tensor 1
+ * @param t2 input tensor 2
+ * @return self
+ */
+tensor * tensor_mat_mul_accumulate(tensor * self, tensor * t1, tensor * t2);
+
+/**
+ * @brief multiply a fused [4H x I] gate weight t1 with t2 and apply the gate activations to the result
+ * 
+ * For int8 weights the dequantization and activations run in the epilogue of the int8 kernel
+ * 
+ * @param self [4H x n] output tensor
+ * @param t1 fused gate weights
+ * @param t2 input tensor
+ * @return self
+ */
+tensor * tensor_mat_mul_gates(tensor * self, tensor * t1, tensor * t2);
+
 /*
 Create a deep copy of the tensor
 */
@@ -113,13 +262,39 @@ int * tensor_shape(tensor * self);
 #define tensor_sigmoid_(t) tensor_sigmoid(t, t)
 
 /**
- * Get the raw pointer values pointed to by the tensor
+ * Get the raw pointer to the first element of the tensor, only valid for DTYPE_F64 tensors. Index views with tensor_strides
  */
 double * tensor_data(tensor * self);
 
+/**
+ * Get the raw pointer to the first element of the tensor in its storage type
+ */
+void * tensor_raw_data(tensor * self);
+dtype tensor_dtype(tensor * self);
+
 void tensor_tanh(tensor * self, tensor * in);
 #define tensor_tanh_(t) tensor_tanh(t, t)
 
+/*
+Applies sigmoid, sigmoid, tanh and sigmoid to the four equal row blocks of a fused [f; i; c; o] gate tensor
+*/
+void tensor_gate_activations(tensor * self, tensor * in);
+#define tensor_gate_activations_(t) tensor_gate_activations(t, t)
+
+/**
+ * @brief Fused backward of one lstm cell step through its activations, see simd_lstm_cell_backward
+ *
+ * Every tensor is a contiguous [hidden x batch] block of one dtype, f64 or f32
+ *
+ * @param d_gates [4 * hidden x batch] output, dL/d of the pre-activations of [f; i; g; o]
+ * @param d_cell dL/dc of the step on entry, dL/dc of the previous step on return
+ * @param d_hidden dL/dh of the step
+ * @param pre_gates f, i, g and o of the step before their activations
+ * @param c_prev cell state before the step
+ * @param c cell state after the step
+ */
+void tensor_lstm_cell_backward(tensor * d_gates, tensor * d_cell, tensor * d_hidden, tensor * pre_gates[4], tensor * c_prev, tensor * c);
+
 #define tensor_create(create, shape) create((ARRAY_LENGTH(shape)),shape)
 #define tensor_zeros(shape) tensor_create((_ ## tensor_zeros), shape)
 #define tensor_ones(shape) tensor_create((_ ## tensor_ones), shape)
@@ -0,0 +1,46 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+/*
+Persistent worker threads shared by the compute kernels, created on first use and reused for every call.
+LSTM_THREADS sets the thread count (default: online cpus) and LSTM_PIN=1 pins worker i to cpu i + 1.
+The calling thread always takes part, so a pool of n threads starts n - 1 workers
+*/
+
+/*
+Runs the half open range [begin, end) of a parallel loop
+*/
+typedef void (*thread_pool_range_fn)(int begin, int end, void * context);
+
+/**
+ * @brief Splits [0, n) into chunks of block iterations and runs them on the pool, returns once all are done
+ *
+ * Runs inline when the pool has one thread, the loop has one chunk or the pool is already busy,
+ * so nested and concurrent calls are safe
+ *
+ * @param n number of iterations
+ * @param block iterations per chunk, chunks are handed out dynamically
+ * @param fn called once per chunk
+ * @param context passed through to fn
+ */
+void thread_pool_parallel_for(int n, int block, thread_pool_range_fn fn, void * context);
+
+/**
+ * @brief Number of threads parallel loops are spread over, the caller included
+ */
+int thread_pool_threads(void);
+
+/**
+ * @brief Replaces the pool with one of the given size, must not run concurrently with a parallel loop
+ *
+ * @param threads number of threads including the caller, 0 for the number of online cpus
+ * @param pin whether workers are pinned to one core each
+ */
+void thread_pool_configure(int threads, int pin);
+
+/**
+ * @brief Stops and joins the workers, the next parallel loop starts a new pool from the environment
+ */
+void thread_pool_shutdown(void);
+
+#endif // THREAD_POOL_H
\ No newline at end of file
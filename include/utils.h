@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdatomic.h>
 
 #define container_of(ptr, type, member) \
     ((type *)((char *)(ptr) - offsetof(type, member)))
@@ -38,30 +39,40 @@ static inline double exp(double x){
     }
 }
 
+/*
+With p = (x + 3)^2 + 3 and q = (x - 3)^2 + 3, EXP(x) = p / q and EXP(-x) = q / p,
+so both activations below reduce to a single division
+*/
 static inline double tanh(double x){
-    return (EXP(x) + EXP(-x))/(EXP(x) - EXP(-x));
+    double p = ((x + 3) * (x + 3)) + 3;
+    double q = ((x - 3) * (x - 3)) + 3;
+    return ((p - q) * (p + q))/((p * p) + (q * q));
 }
 
 static inline double sigmoid(double x){
-    return 1/(1 + EXP(-x));
+    double p = ((x + 3) * (x + 3)) + 3;
+    double q = ((x - 3) * (x - 3)) + 3;
+    return p/(p + q);
 }
 
 /*
 Reference counter via https://nullprogram.com/blog/2015/02/17/
+The count is atomic so objects can be shared and released from any thread.
+Taking a reference needs no ordering, dropping the last one must see every write made through the others
 */
 struct ref {
     void (*free)(const struct ref *);
-    int count;
+    atomic_int count;
 };
 
 static inline void ref_inc(const struct ref *ref)
 {
-    ((struct ref *)ref)->count++;
+    atomic_fetch_add_explicit(&((struct ref *)ref)->count, 1, memory_order_relaxed);
 }
 
 static inline void ref_dec(const struct ref *ref)
 {
-    if (--((struct ref *)ref)->count == 0)
+    if (atomic_fetch_sub_explicit(&((struct ref *)ref)->count, 1, memory_order_acq_rel) == 1)
         ref->free(ref);
 }
 
@@ -0,0 +1,150 @@
+#define _GNU_SOURCE
+#include <sys/mman.h>
+
+#include "arena.h"
+#include "utils.h"
+
+typedef struct arena_block arena_block;
+
+struct arena_block{
+    arena_block * next;
+    size_t size;
+    size_t used;
+    // start of the mapping, the block header lives in its first cache line
+    char * base;
+};
+
+struct arena{
+    arena_block * head;
+    size_t block_size;
+    size_t used;
+};
+
+static _Thread_local arena * current_arena = NULL;
+
+static inline size_t align_up(size_t value, size_t alignment){
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+/*
+Tries explicit hugepages first, then a regular mapping with transparent hugepages requested
+*/
+static void * map_region(size_t size){
+    void * ptr = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    // without MAP_NORESERVE the mapping fails up front instead of faulting when the hugepage pool is short
+    if(size % ARENA_HUGEPAGE_SIZE == 0){
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+
+    if(ptr == MAP_FAILED){
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+#ifdef MADV_HUGEPAGE
+        if(ptr != MAP_FAILED){
+            madvise(ptr, size, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    if(ptr == MAP_FAILED){
+        PANIC("Failed to map %zu bytes for the arena\n", size);
+    }
+
+    return ptr;
+}
+
+static arena_block * arena_block_init(size_t size){
+    size = align_up(size + ARENA_ALIGNMENT, ARENA_HUGEPAGE_SIZE);
+
+    char * base = (char *)map_region(size);
+
+    arena_block * block = (arena_block *)base;
+    block->next = NULL;
+    block->size = size;
+    block->used = align_up(sizeof(arena_block), ARENA_ALIGNMENT);
+    block->base = base;
+
+    return block;
+}
+
+arena * arena_init(size_t capacity){
+    arena * self = (arena *)SAFE_MALLOC(sizeof(arena));
+
+    self->head = arena_block_init(capacity);
+    self->block_size = self->head->size;
+    self->used = 0;
+
+    return self;
+}
+
+void * arena_alloc(arena * self, size_t size){
+    size = align_up(size == 0 ? 1 : size, ARENA_ALIGNMENT);
+
+    arena_block * block = self->head;
+    if(block->used + size > block->size){
+        block = arena_block_init(size > self->block_size ? size : self->block_size);
+        block->next = self->head;
+        self->head = block;
+    }
+
+    void * ptr = block->base + block->used;
+    block->used += size;
+    self->used += size;
+
+    return ptr;
+}
+
+size_t arena_used(arena * self){
+    return self->used;
+}
+
+arena_mark arena_position(arena * self){
+    return (arena_mark){self->head, self->head->used, self->used};
+}
+
+void arena_rewind(arena * self, arena_mark mark){
+    while(self->head != mark.block){
+        if(self->head->next == NULL){
+            PANIC("Arena mark from another arena");
+        }
+
+        arena_block * next = self->head->next;
+        munmap(self->head->base, self->head->size);
+        self->head = next;
+    }
+
+    self->head->used = mark.offset;
+    self->used = mark.used;
+}
+
+void arena_cleanup(arena * self){
+    if(self == NULL){
+        return;
+    }
+
+    if(current_arena == self){
+        current_arena = NULL;
+    }
+
+    arena_block * block = self->head;
+    while(block != NULL){
+        arena_block * next = block->next;
+        munmap(block->base, block->size);
+        block = next;
+    }
+
+    SAFE_FREE(self);
+}
+
+arena * arena_set_current(arena * self){
+    arena * previous = current_arena;
+    current_arena = self;
+    return previous;
+}
+
+arena * arena_current(void){
+    return current_arena;
+}
\ No newline at end of file
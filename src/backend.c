@@ -0,0 +1,152 @@
+#include <string.h>
+
+#include "backend.h"
+#include "gemm.h"
+#include "pim.h"
+
+static void reference_mat_mul(int m, int n, int k, const double * a, int rsa, int csa, const double * b, int rsb, int csb, 
+    double * c, int ldc, int accumulate){
+    for(int i = 0; i < m; i++){
+        for(int j = 0; j < n; j++){
+            double sum = 0;
+            for(int p = 0; p < k; p++){
+                sum += a[(long)i * rsa + (long)p * csa] * b[(long)p * rsb + (long)j * csb];
+            }
+            c[(long)i * ldc + j] = accumulate ? c[(long)i * ldc + j] + sum : sum;
+        }
+    }
+}
+
+static void reference_mat_mul_f32(int m, int n, int k, const void * a, dtype a_type, int rsa, int csa, 
+    const void * b, dtype b_type, int rsb, int csb, void * c, dtype c_type, int ldc, int accumulate){
+    for(int i = 0; i < m; i++){
+        for(int j = 0; j < n; j++){
+            float sum = 0;
+            for(int p = 0; p < k; p++){
+                sum += (float)dtype_get(a, a_type, (long)i * rsa + (long)p * csa) * (float)dtype_get(b, b_type, (long)p * rsb + (long)j * csb);
+            }
+            dtype_set(c, c_type, (long)i * ldc + j, accumulate ? (float)dtype_get(c, c_type, (long)i * ldc + j) + sum : sum);
+        }
+    }
+}
+
+static backend_ops reference_ops = {
+    .kind = BACKEND_REFERENCE,
+    .name = "reference",
+    .mat_mul = reference_mat_mul,
+    .mat_mul_f32 = reference_mat_mul_f32,
+};
+
+static backend_ops cpu_ops = {
+    .kind = BACKEND_CPU,
+    .name = "cpu",
+    .mat_mul = gemm_strided_serial,
+    .mat_mul_f32 = gemm_f32_strided_serial,
+};
+
+static backend_ops threaded_ops = {
+    .kind = BACKEND_THREADED,
+    .name = "threaded",
+    .mat_mul = gemm_strided,
+    .mat_mul_f32 = gemm_f32_strided,
+};
+
+// the banks only take f64 products, the rest runs on the host
+static backend_ops pim_ops = {
+    .kind = BACKEND_PIM,
+    .name = "pim",
+    .mat_mul = pim_mat_mul,
+};
+
+static backend_ops * const backends[] = {&reference_ops, &cpu_ops, &threaded_ops, &pim_ops};
+
+static const backend_ops * default_ops = NULL;
+static _Thread_local const backend_ops * current_ops = NULL;
+
+#define BACKEND_FALLBACK(ops, fallback, kernel) if((ops)->kernel == NULL){(ops)->kernel = (fallback)->kernel;}
+
+static void backend_fill(backend_ops * ops, const backend_ops * fallback){
+    BACKEND_FALLBACK(ops, fallback, mat_mul);
+    BACKEND_FALLBACK(ops, fallback, mat_mul_f32);
+    BACKEND_FALLBACK(ops, fallback, sigmoid);
+    BACKEND_FALLBACK(ops, fallback, tanh);
+    BACKEND_FALLBACK(ops, fallback, lstm_gates);
+    BACKEND_FALLBACK(ops, fallback, add);
+    BACKEND_FALLBACK(ops, fallback, mul);
+}
+
+static backend_kind backend_kind_from_env(void){
+    const char * name = getenv("LSTM_BACKEND");
+
+    if(name == NULL){
+        return BACKEND_THREADED;
+    }
+
+    for(size_t i = 0; i < ARRAY_LENGTH(backends); i++){
+        if(strcmp(name, backends[i]->name) == 0){
+            return backends[i]->kind;
+        }
+    }
+
+    // a typo in a deployment should not take the service down
+    fprintf(stderr, "Unknown LSTM_BACKEND value %s, using threaded\n", name);
+    return BACKEND_THREADED;
+}
+
+/*
+Completes every table along the fallback chain and picks the default. Runs before main so later calls never race on it
+*/
+__attribute__((constructor)) static void backend_init(void){
+    if(default_ops != NULL){
+        return;
+    }
+
+    const simd_ops * scalar = simd_ops_for(SIMD_SCALAR);
+    reference_ops.sigmoid = scalar->sigmoid;
+    reference_ops.tanh = scalar->tanh;
+    reference_ops.lstm_gates = scalar->lstm_gates;
+    reference_ops.add = scalar->add;
+    reference_ops.mul = scalar->mul;
+
+    const simd_ops * simd = simd_get_ops();
+    cpu_ops.sigmoid = simd->sigmoid;
+    cpu_ops.tanh = simd->tanh;
+    cpu_ops.lstm_gates = simd->lstm_gates;
+    cpu_ops.add = simd->add;
+    cpu_ops.mul = simd->mul;
+    backend_fill(&cpu_ops, &reference_ops);
+
+    backend_fill(&threaded_ops, &cpu_ops);
+    backend_fill(&pim_ops, &threaded_ops);
+
+    default_ops = backends[backend_kind_from_env()];
+}
+
+const backend_ops * backend_for(backend_kind kind){
+    if(default_ops == NULL){
+        backend_init();
+    }
+
+    TENSOR_CHECK((size_t)kind >= ARRAY_LENGTH(backends), "Unknown backend %d", (int)kind);
+
+    return backends[kind];
+}
+
+const backend_ops * backend_get(void){
+    if(current_ops != NULL){
+        return current_ops;
+    }
+
+    if(default_ops == NULL){
+        backend_init();
+    }
+
+    return default_ops;
+}
+
+const backend_ops * backend_set_current(const backend_ops * ops){
+    const backend_ops * previous = current_ops;
+    current_ops = ops;
+
+    return previous;
+}
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include "bidirectional.h"
+#include "thread_pool.h"
+
+lstm_bidirectional * lstm_bidirectional_init(int input_size, int hidden_size, int output_size, int sequence_length, int flags){
+    TENSOR_CHECK(flags & LSTM_INFERENCE, "A bidirectional LSTM needs the per timestep history");
+
+    lstm_bidirectional * lstm = (lstm_bidirectional *)SAFE_MALLOC(sizeof(lstm_bidirectional));
+    lstm->forward = lstm_init_with_flags(input_size, hidden_size, output_size, sequence_length, flags);
+    lstm->backward = lstm_init_with_flags(input_size, hidden_size, output_size, sequence_length, flags);
+
+    tensor * any = lstm->forward->outputs[0];
+    lstm->reversed = tensor_view(any);
+    lstm->forward_view = tensor_view(any);
+    lstm->backward_view = tensor_view(any);
+    lstm->backward_output = tensor_view(any);
+
+    lstm->inputs = NULL;
+    lstm->outputs = NULL;
+    lstm->batch = 0;
+
+    return lstm;
+}
+
+static void lstm_bidirectional_forward_direction(lstm_bidirectional * self){
+    LSTM * lstm = self->forward;
+    int output_size = lstm->output_size;
+
+    tensor ** outputs = lstm_forward_batch(lstm, self->inputs, self->batch);
+
+    for(int t = 0; t < lstm->sequence_length; t++){
+        tensor_slice(self->forward_view, self->outputs, 0, 2 * t * output_size, output_size);
+        tensor_convert(self->forward_view, outputs[t]);
+    }
+}
+
+/*
+Reversing the rows of [batch * rows x features] reverses the steps and the order of the sequences,
+step s of column b is step rows - 1 - s of sequence batch - 1 - b. Both are undone while copying out
+*/
+static void lstm_bidirectional_backward_direction(lstm_bidirectional * self){
+    LSTM * lstm = self->backward;
+    int output_size = lstm->output_size;
+    int steps = lstm->sequence_length;
+
+    tensor_reverse(self->reversed, self->inputs, 0);
+    tensor ** outputs = lstm_forward_batch(lstm, self->reversed, self->batch);
+
+    for(int s = 0; s < steps; s++){
+        int t = steps - 1 - s;
+
+        tensor_slice(self->backward_view, self->outputs, 0, (2 * t + 1) * output_size, output_size);
+        tensor_convert(self->backward_view, tensor_reverse(self->backward_output, outputs[s], 1));
+    }
+}
+
+static void lstm_bidirectional_direction(int begin, int end, void * context){
+    lstm_bidirectional * self = (lstm_bidirectional *)context;
+
+    for(int direction = begin; direction < end; direction++){
+        if(direction == 0){
+            lstm_bidirectional_forward_direction(self);
+        }else{
+            lstm_bidirectional_backward_direction(self);
+        }
+    }
+}
+
+tensor * lstm_bidirectional_forward(lstm_bidirectional * self, tensor * inputs, int batch, tensor * outputs){
+    TENSOR_EXIST(inputs);
+    TENSOR_EXIST(outputs);
+    TENSOR_CHECK(batch < 1, "Batch size should at least be 1, got %d", batch);
+
+    int steps = self->forward->sequence_length;
+    int output_size = self->forward->output_size;
+
+    // the backward direction starts at the last row, so a sequence has to end where the model does
+    TENSOR_CHECK(tensor_shape(inputs)[0] != batch * steps, 
+        "Inputs should have %d rows for %d sequences of %d steps, got %d", batch * steps, batch, steps, tensor_shape(inputs)[0]
+    );
+
+    int * output_shape = tensor_shape(outputs);
+    TENSOR_CHECK(output_shape[0] != steps * 2 * output_size || output_shape[1] != batch, 
+        "Output buffer should be [%d x %d], got [%d x %d]", steps * 2 * output_size, batch, output_shape[0], output_shape[1]
+    );
+
+    self->inputs = inputs;
+    self->outputs = outputs;
+    self->batch = batch;
+
+    // one direction per thread, their matrix products run inline on that thread while the pool is busy
+    thread_pool_parallel_for(2, 1, lstm_bidirectional_direction, self);
+
+    self->inputs = NULL;
+    self->outputs = NULL;
+
+    return outputs;
+}
+
+void lstm_bidirectional_cleanup(lstm_bidirectional * self){
+    if(self == NULL){
+        return;
+    }
+
+    tensor_cleanup(self->reversed);
+    tensor_cleanup(self->forward_view);
+    tensor_cleanup(self->backward_view);
+    tensor_cleanup(self->backward_output);
+
+    lstm_cleanup(self->forward);
+    lstm_cleanup(self->backward);
+
+    SAFE_FREE(self);
+}
\ No newline at end of file
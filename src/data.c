@@ -1,14 +1,21 @@
 #include "data.h"
+#include "arena.h"
 #include "assert.h"
 
 struct Data{
-    double * ptr;
+    void * ptr;
     int size;
+    dtype type;
     struct ref refcount;
+    // set when header and payload were bump allocated, the arena frees them
+    arena * arena;
+    // set when ptr is borrowed, it is never freed and the reference to its owner, if any, is dropped instead
+    int external;
+    const struct ref * owner;
 };
 
-static inline double * default_alloc(size_t size){
-    return (double *)SAFE_MALLOC(size);
+static inline void * default_alloc(size_t size){
+    return SAFE_MALLOC(size);
 }
 
 void data_dec(Data * self){
@@ -21,13 +28,18 @@ void data_inc(Data * self){
 
 void data_free(const struct ref *ref){
     Data * data = container_of(ref, Data, refcount);
-    if(data != NULL){
-        SAFE_FREE(data->ptr);
+    const struct ref * owner = data->owner;
+
+    if(data->arena == NULL){
+        if(!data->external){
+            SAFE_FREE(data->ptr);
+        }
         SAFE_FREE(data);
     }
-    
 
-    data = NULL;
+    if(owner != NULL){
+        ref_dec(owner);
+    }
 }
 
 Data * data_init(int size){
@@ -35,46 +47,96 @@ Data * data_init(int size){
 }
 
 Data * data_init_with_allocator(int size, allocator alloc){
+    return data_init_typed(size, DTYPE_F64, alloc);
+}
+
+Data * data_init_with_dtype(int size, dtype type){
+    return data_init_typed(size, type, default_alloc);
+}
+
+Data * data_init_typed(int size, dtype type, allocator alloc){
     assert(size > 0);
 
-    Data * data = (Data *)SAFE_MALLOC(sizeof(Data));
+    // an active arena only replaces the default allocator, custom ones keep their heap semantics
+    arena * owner = alloc == default_alloc ? arena_current() : NULL;
+
+    Data * data = owner != NULL ? (Data *)arena_alloc(owner, sizeof(Data)) : (Data *)SAFE_MALLOC(sizeof(Data));
     data->size = size;
-    data->refcount = (struct ref){.count = 1, .free = data_free};
-    data->ptr = alloc(sizeof(double) * size);
+    data->type = type;
+    data->refcount.free = data_free;
+    atomic_init(&data->refcount.count, 1);
+    data->arena = owner;
+    data->external = 0;
+    data->owner = NULL;
+    data->ptr = owner != NULL ? arena_alloc(owner, dtype_size(type) * size) : alloc(dtype_size(type) * size);
     return data;   
 }
 
+Data * data_init_external(int size, dtype type, void * ptr, const struct ref * owner){
+    assert(size > 0);
+    assert(ptr != NULL);
+
+    // the header follows the arena like any other, the payload stays where it is
+    arena * memory = arena_current();
+
+    Data * data = memory != NULL ? (Data *)arena_alloc(memory, sizeof(Data)) : (Data *)SAFE_MALLOC(sizeof(Data));
+    data->size = size;
+    data->type = type;
+    data->refcount.free = data_free;
+    atomic_init(&data->refcount.count, 1);
+    data->arena = memory;
+    data->external = 1;
+    data->owner = owner;
+    data->ptr = ptr;
+
+    if(owner != NULL){
+        ref_inc(owner);
+    }
+
+    return data;
+}
+
 void data_insert(Data * self, double value, int index){
     assert(index < self->size);
 
     if(self->ptr == NULL){
-        self->ptr = (double *)SAFE_MALLOC(self->size);
+        self->ptr = SAFE_MALLOC(dtype_size(self->type) * self->size);
     }
 
-    self->ptr[index] = value;
+    dtype_set(self->ptr, self->type, index, value);
 }
 
 void data_memcpy(Data * dest, Data * src, int dest_offset, int src_offset, int length){
     if(dest->ptr == NULL){
-        dest->ptr = SAFE_MALLOC(sizeof(double) * dest->size);
+        dest->ptr = SAFE_MALLOC(dtype_size(dest->type) * dest->size);
     }
 
-    for(int i = 0; i < length; i++){
-        dest->ptr[i + dest_offset] = src->ptr[i + src_offset];
-    }
+    dtype_convert(
+        (char *)src->ptr + src_offset * dtype_size(src->type), src->type, 
+        (char *)dest->ptr + dest_offset * dtype_size(dest->type), dest->type, 
+        length
+    );
 }
 
 double data_get(Data * self, int index){
     assert(index < self->size);
     assert(self->ptr != NULL);
 
-    return self->ptr[index];
+    return dtype_get(self->ptr, self->type, index);
 }
 
-double * data_raw_ptr(Data * self){
+void * data_raw_ptr(Data * self){
     return self->ptr;
 }
 
-void data_assign_ptr(Data * self, double * ptr){
+void data_assign_ptr(Data * self, void * ptr){
     self->ptr = ptr;
 }
+
+dtype data_dtype(Data * self){
+    return self->type;
+}
+
+int data_size(Data * self){
+    return self->size;
+}
@@ -0,0 +1,61 @@
+#include "dtype.h"
+#include "simd.h"
+#include "utils.h"
+
+const char * dtype_name(dtype type){
+    switch(type){
+        case DTYPE_F32:
+            return "f32";
+        case DTYPE_BF16:
+            return "bf16";
+        case DTYPE_I8:
+            return "i8";
+        default:
+            return "f64";
+    }
+}
+
+SIMD_TARGET_CLONES static void f64_to_f32(const double * src, float * dest, size_t length){
+    for(size_t i = 0; i < length; i++){
+        dest[i] = (float)src[i];
+    }
+}
+
+SIMD_TARGET_CLONES static void f32_to_f64(const float * src, double * dest, size_t length){
+    for(size_t i = 0; i < length; i++){
+        dest[i] = src[i];
+    }
+}
+
+SIMD_TARGET_CLONES static void f32_to_bf16_array(const float * src, bfloat16 * dest, size_t length){
+    for(size_t i = 0; i < length; i++){
+        dest[i] = f32_to_bf16(src[i]);
+    }
+}
+
+SIMD_TARGET_CLONES static void bf16_to_f32_array(const bfloat16 * src, float * dest, size_t length){
+    for(size_t i = 0; i < length; i++){
+        dest[i] = bf16_to_f32(src[i]);
+    }
+}
+
+void dtype_convert(const void * src, dtype src_type, void * dest, dtype dest_type, size_t length){
+    if(src_type == dest_type){
+        memmove(dest, src, length * dtype_size(src_type));
+        return;
+    }
+
+    if(src_type == DTYPE_F64 && dest_type == DTYPE_F32){
+        f64_to_f32(src, dest, length);
+    }else if(src_type == DTYPE_F32 && dest_type == DTYPE_F64){
+        f32_to_f64(src, dest, length);
+    }else if(src_type == DTYPE_F32 && dest_type == DTYPE_BF16){
+        f32_to_bf16_array(src, dest, length);
+    }else if(src_type == DTYPE_BF16 && dest_type == DTYPE_F32){
+        bf16_to_f32_array(src, dest, length);
+    }else{
+        for(size_t i = 0; i < length; i++){
+            dtype_set(dest, dest_type, i, dtype_get(src, src_type, i));
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,577 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "gemm.h"
+#include "utils.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define ROUND_UP(x, r) ((((x) + (r) - 1) / (r)) * (r))
+
+typedef struct gemm_scratch_buffers{
+    void * ptr[GEMM_SCRATCH_COUNT];
+    size_t bytes[GEMM_SCRATCH_COUNT];
+} gemm_scratch_buffers;
+
+static _Thread_local gemm_scratch_buffers * scratch_buffers = NULL;
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_once = PTHREAD_ONCE_INIT;
+
+static void gemm_scratch_free(void * ptr){
+    gemm_scratch_buffers * buffers = (gemm_scratch_buffers *)ptr;
+
+    for(int i = 0; i < GEMM_SCRATCH_COUNT; i++){
+        SAFE_FREE(buffers->ptr[i]);
+    }
+    SAFE_FREE(buffers);
+}
+
+static void gemm_scratch_key_init(void){
+    // the destructor frees the buffers of pool and scheduler workers when they are joined
+    pthread_key_create(&scratch_key, gemm_scratch_free);
+}
+
+void * gemm_scratch(gemm_scratch_slot slot, size_t bytes){
+    gemm_scratch_buffers * buffers = scratch_buffers;
+
+    if(buffers == NULL){
+        pthread_once(&scratch_once, gemm_scratch_key_init);
+
+        buffers = (gemm_scratch_buffers *)SAFE_MALLOC(sizeof(gemm_scratch_buffers));
+        memset(buffers, 0, sizeof(gemm_scratch_buffers));
+        pthread_setspecific(scratch_key, buffers);
+        scratch_buffers = buffers;
+    }
+
+    if(buffers->bytes[slot] < bytes){
+        SAFE_FREE(buffers->ptr[slot]);
+        buffers->ptr[slot] = SAFE_MALLOC(bytes);
+        buffers->bytes[slot] = bytes;
+    }
+
+    return buffers->ptr[slot];
+}
+
+/*
+Packs a mc x kc block of a into MR tall row slivers, each stored column by column. Rows past mc are zero padded.
+Element (i, p) of the block is a[i * rsa + p * csa]
+*/
+static void pack_a(int mc, int kc, const double * a, int rsa, int csa, double * packed){
+    for(int i = 0; i < mc; i += GEMM_MR){
+        int rows = MIN(GEMM_MR, mc - i);
+
+        for(int p = 0; p < kc; p++){
+            for(int r = 0; r < rows; r++){
+                packed[r] = a[(long)(i + r) * rsa + (long)p * csa];
+            }
+            for(int r = rows; r < GEMM_MR; r++){
+                packed[r] = 0.0;
+            }
+            packed += GEMM_MR;
+        }
+    }
+}
+
+/*
+Packs a kc x nc panel of b into NR wide column slivers, each stored row by row. Columns past nc are zero padded.
+Element (p, j) of the panel is b[p * rsb + j * csb]
+*/
+static void pack_b(int kc, int nc, const double * b, int rsb, int csb, double * packed){
+    for(int j = 0; j < nc; j += GEMM_NR){
+        int cols = MIN(GEMM_NR, nc - j);
+
+        for(int p = 0; p < kc; p++){
+            const double * row = b + (long)p * rsb + (long)j * csb;
+            if(csb == 1){
+                for(int c = 0; c < cols; c++){
+                    packed[c] = row[c];
+                }
+            }else{
+                for(int c = 0; c < cols; c++){
+                    packed[c] = row[(long)c * csb];
+                }
+            }
+            for(int c = cols; c < GEMM_NR; c++){
+                packed[c] = 0.0;
+            }
+            packed += GEMM_NR;
+        }
+    }
+}
+
+/*
+Computes a MR x NR tile of packed a times packed b in registers, then stores or accumulates the
+valid rows x cols corner into c
+*/
+static inline void micro_kernel(int kc, const double * a, const double * b, double * c, int ldc, int rows, int cols, int accumulate){
+    double acc[GEMM_MR][GEMM_NR] = {{0}};
+
+    for(int p = 0; p < kc; p++){
+        for(int i = 0; i < GEMM_MR; i++){
+            double a_ip = a[i];
+            for(int j = 0; j < GEMM_NR; j++){
+                acc[i][j] += a_ip * b[j];
+            }
+        }
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+
+    for(int i = 0; i < rows; i++){
+        double * c_row = c + i * ldc;
+        if(accumulate){
+            for(int j = 0; j < cols; j++){
+                c_row[j] += acc[i][j];
+            }
+        }else{
+            for(int j = 0; j < cols; j++){
+                c_row[j] = acc[i][j];
+            }
+        }
+    }
+}
+
+/*
+Multiplies a packed mc x kc block of a with a packed kc x nc panel of b into c
+*/
+SIMD_TARGET_CLONES static void macro_kernel(int mc, int nc, int kc, const double * packed_a, const double * packed_b, double * c, int ldc, int accumulate){
+    for(int j = 0; j < nc; j += GEMM_NR){
+        int cols = MIN(GEMM_NR, nc - j);
+        const double * b_sliver = packed_b + j * kc;
+
+        for(int i = 0; i < mc; i += GEMM_MR){
+            int rows = MIN(GEMM_MR, mc - i);
+            micro_kernel(kc, packed_a + i * kc, b_sliver, c + i * ldc + j, ldc, rows, cols, accumulate);
+        }
+    }
+}
+
+/*
+Unpacked i-k-j loop for matrices too small to amortize packing, streams rows of b and c.
+a may be strided, the rows of b have to be contiguous
+*/
+SIMD_TARGET_CLONES static void gemm_small(int m, int n, int k, const double * a, int rsa, int csa, const double * b, int ldb, double * c, int ldc, int accumulate){
+    for(int i = 0; i < m; i++){
+        double * c_row = c + i * ldc;
+        for(int j = 0; j < n && !accumulate; j++){
+            c_row[j] = 0.0;
+        }
+
+        for(int p = 0; p < k; p++){
+            double a_ip = a[(long)i * rsa + (long)p * csa];
+            const double * b_row = b + (long)p * ldb;
+            for(int j = 0; j < n; j++){
+                c_row[j] += a_ip * b_row[j];
+            }
+        }
+    }
+}
+
+static void gemv_strided(int m, int k, const double * a, int lda, const double * x, double * y, int incy, int accumulate);
+
+void gemm(int m, int n, int k, const double * a, int lda, const double * b, int ldb, double * c, int ldc){
+    gemm_strided(m, n, k, a, lda, 1, b, ldb, 1, c, ldc, 0);
+}
+
+void gemm_strided_serial(int m, int n, int k, const double * a, int rsa, int csa, const double * b, int rsb, int csb, double * c, int ldc, int accumulate){
+    // a single column of c, ldc apart
+    if(n == 1 && csa == 1 && rsa > 0 && rsb == 1){
+        gemv_strided(m, k, a, rsa, b, c, ldc, accumulate);
+        return;
+    }
+
+    if((long)m * n * k <= GEMM_SMALL_FLOPS && csb == 1){
+        gemm_small(m, n, k, a, rsa, csa, b, rsb, c, ldc, accumulate);
+        return;
+    }
+
+    int kc_max = MIN(k, GEMM_KC);
+    double * packed_a = (double *)gemm_scratch(GEMM_SCRATCH_PACKED_A, sizeof(double) * ROUND_UP(MIN(m, GEMM_MC), GEMM_MR) * kc_max);
+    double * packed_b = (double *)gemm_scratch(GEMM_SCRATCH_PACKED_B, sizeof(double) * ROUND_UP(MIN(n, GEMM_NC), GEMM_NR) * kc_max);
+
+    for(int jc = 0; jc < n; jc += GEMM_NC){
+        int nc = MIN(GEMM_NC, n - jc);
+
+        for(int pc = 0; pc < k; pc += GEMM_KC){
+            int kc = MIN(GEMM_KC, k - pc);
+            // the first k block overwrites c unless the caller accumulates, so no separate zero fill is needed
+            int add = accumulate || pc > 0;
+
+            pack_b(kc, nc, b + (long)pc * rsb + (long)jc * csb, rsb, csb, packed_b);
+
+            for(int ic = 0; ic < m; ic += GEMM_MC){
+                int mc = MIN(GEMM_MC, m - ic);
+
+                pack_a(mc, kc, a + (long)ic * rsa + (long)pc * csa, rsa, csa, packed_a);
+                macro_kernel(mc, nc, kc, packed_a, packed_b, c + ic * ldc + jc, ldc, add);
+            }
+        }
+    }
+}
+
+/*
+Operands of a product split into row blocks across the thread pool
+*/
+typedef struct gemm_job{
+    int n;
+    int k;
+    const void * a;
+    dtype a_type;
+    int rsa;
+    int csa;
+    const void * b;
+    dtype b_type;
+    int rsb;
+    int csb;
+    void * c;
+    dtype c_type;
+    int ldc;
+    int accumulate;
+} gemm_job;
+
+/*
+Rows per parallel chunk, one chunk per thread rounded to whole micro tiles. 0 keeps the product on the calling thread
+*/
+static int gemm_row_block(int m, int n, int k, int mr){
+    if((long)m * n * k < GEMM_PARALLEL_FLOPS || m < 2 * mr){
+        return 0;
+    }
+
+    int threads = thread_pool_threads();
+    return ROUND_UP((m + threads - 1) / threads, mr);
+}
+
+static void gemm_rows(int begin, int end, void * context){
+    gemm_job * job = (gemm_job *)context;
+
+    gemm_strided_serial(end - begin, job->n, job->k, (const double *)job->a + (long)begin * job->rsa, job->rsa, job->csa, 
+        job->b, job->rsb, job->csb, (double *)job->c + (long)begin * job->ldc, job->ldc, job->accumulate
+    );
+}
+
+void gemm_strided(int m, int n, int k, const double * a, int rsa, int csa, const double * b, int rsb, int csb, double * c, int ldc, int accumulate){
+    int block = gemm_row_block(m, n, k, GEMM_MR);
+
+    if(block == 0){
+        gemm_strided_serial(m, n, k, a, rsa, csa, b, rsb, csb, c, ldc, accumulate);
+        return;
+    }
+
+    gemm_job job = {
+        .n = n, .k = k, 
+        .a = a, .a_type = DTYPE_F64, .rsa = rsa, .csa = csa, 
+        .b = b, .b_type = DTYPE_F64, .rsb = rsb, .csb = csb, 
+        .c = c, .c_type = DTYPE_F64, .ldc = ldc, .accumulate = accumulate,
+    };
+    thread_pool_parallel_for(m, block, gemm_rows, &job);
+}
+
+void gemv(int m, int k, const double * a, int lda, const double * x, double * y){
+    gemv_strided(m, k, a, lda, x, y, 1, 0);
+}
+
+/*
+y = a * x or y += a * x with y[i] at y + i * incy, so a column of a matrix can be the output
+*/
+SIMD_TARGET_CLONES static void gemv_strided(int m, int k, const double * a, int lda, const double * x, double * y, int incy, int accumulate){
+    int i = 0;
+
+    // four rows share every load of x
+    for(; i + 4 <= m; i += 4){
+        const double * a0 = a + i * lda;
+        const double * a1 = a0 + lda;
+        const double * a2 = a1 + lda;
+        const double * a3 = a2 + lda;
+
+        double acc[4][GEMV_LANES] = {{0}};
+        int p = 0;
+        for(; p + GEMV_LANES <= k; p += GEMV_LANES){
+            for(int l = 0; l < GEMV_LANES; l++){
+                double x_p = x[p + l];
+                acc[0][l] += a0[p + l] * x_p;
+                acc[1][l] += a1[p + l] * x_p;
+                acc[2][l] += a2[p + l] * x_p;
+                acc[3][l] += a3[p + l] * x_p;
+            }
+        }
+
+        for(int r = 0; r < 4; r++){
+            const double * a_row = a0 + r * lda;
+            double output = 0.0;
+            for(int l = 0; l < GEMV_LANES; l++){
+                output += acc[r][l];
+            }
+            for(int q = p; q < k; q++){
+                output += a_row[q] * x[q];
+            }
+            y[(long)(i + r) * incy] = accumulate ? y[(long)(i + r) * incy] + output : output;
+        }
+    }
+
+    for(; i < m; i++){
+        const double * a_row = a + i * lda;
+        double output = 0.0;
+        for(int p = 0; p < k; p++){
+            output += a_row[p] * x[p];
+        }
+        y[(long)i * incy] = accumulate ? y[(long)i * incy] + output : output;
+    }
+}
+
+/*
+fp32 engine, same blocking as the fp64 one with operands widened to float while packing
+*/
+
+static inline float load_f32(const void * ptr, dtype type, long index){
+    return type == DTYPE_BF16 ? bf16_to_f32(((const bfloat16 *)ptr)[index]) : ((const float *)ptr)[index];
+}
+
+static void pack_a_f32(int mc, int kc, const void * a, dtype type, long offset, int rsa, int csa, float * packed){
+    for(int i = 0; i < mc; i += GEMM_MR_F32){
+        int rows = MIN(GEMM_MR_F32, mc - i);
+
+        for(int p = 0; p < kc; p++){
+            for(int r = 0; r < rows; r++){
+                packed[r] = load_f32(a, type, offset + (long)(i + r) * rsa + (long)p * csa);
+            }
+            for(int r = rows; r < GEMM_MR_F32; r++){
+                packed[r] = 0.0f;
+            }
+            packed += GEMM_MR_F32;
+        }
+    }
+}
+
+static void pack_b_f32(int kc, int nc, const void * b, dtype type, long offset, int rsb, int csb, float * packed){
+    for(int j = 0; j < nc; j += GEMM_NR_F32){
+        int cols = MIN(GEMM_NR_F32, nc - j);
+
+        for(int p = 0; p < kc; p++){
+            long row = offset + (long)p * rsb + (long)j * csb;
+            for(int c = 0; c < cols; c++){
+                packed[c] = load_f32(b, type, row + (long)c * csb);
+            }
+            for(int c = cols; c < GEMM_NR_F32; c++){
+                packed[c] = 0.0f;
+            }
+            packed += GEMM_NR_F32;
+        }
+    }
+}
+
+typedef float f32_row __attribute__((vector_size(GEMM_NR_F32 * sizeof(float))));
+
+static inline void micro_kernel_f32(int kc, const float * a, const float * b, float * c, int ldc, int rows, int cols, int accumulate){
+    // one vector per row of the tile, from plain loops GCC vectorizes across the four rows with 16 byte
+    // vectors instead of along a row
+    f32_row acc[GEMM_MR_F32] = {0};
+
+    for(int p = 0; p < kc; p++){
+        f32_row b_p;
+        memcpy(&b_p, b, sizeof(b_p));
+
+        for(int i = 0; i < GEMM_MR_F32; i++){
+            acc[i] += a[i] * b_p;
+        }
+        a += GEMM_MR_F32;
+        b += GEMM_NR_F32;
+    }
+
+    for(int i = 0; i < rows; i++){
+        float * c_row = c + i * ldc;
+        if(accumulate){
+            for(int j = 0; j < cols; j++){
+                c_row[j] += acc[i][j];
+            }
+        }else{
+            for(int j = 0; j < cols; j++){
+                c_row[j] = acc[i][j];
+            }
+        }
+    }
+}
+
+SIMD_TARGET_CLONES static void macro_kernel_f32(int mc, int nc, int kc, const float * packed_a, const float * packed_b, float * c, int ldc, int accumulate){
+    for(int j = 0; j < nc; j += GEMM_NR_F32){
+        int cols = MIN(GEMM_NR_F32, nc - j);
+        const float * b_sliver = packed_b + j * kc;
+
+        for(int i = 0; i < mc; i += GEMM_MR_F32){
+            int rows = MIN(GEMM_MR_F32, mc - i);
+            micro_kernel_f32(kc, packed_a + i * kc, b_sliver, c + i * ldc + j, ldc, rows, cols, accumulate);
+        }
+    }
+}
+
+static void gemv_f32_strided(int m, int k, const void * a, dtype a_type, int lda, const void * x, dtype x_type, 
+    void * y, dtype y_type, int incy, int accumulate);
+
+void gemm_f32(int m, int n, int k, const void * a, dtype a_type, int lda, const void * b, dtype b_type, int ldb, void * c, dtype c_type, int ldc){
+    gemm_f32_strided(m, n, k, a, a_type, lda, 1, b, b_type, ldb, 1, c, c_type, ldc, 0);
+}
+
+void gemm_f32_strided_serial(int m, int n, int k, const void * a, dtype a_type, int rsa, int csa, const void * b, dtype b_type, int rsb, int csb, 
+    void * c, dtype c_type, int ldc, int accumulate){
+    if(n == 1 && csa == 1 && rsa > 0 && rsb == 1){
+        gemv_f32_strided(m, k, a, a_type, rsa, b, b_type, c, c_type, ldc, accumulate);
+        return;
+    }
+
+    // narrow outputs are accumulated in a float buffer and rounded once at the end
+    float * out = c_type == DTYPE_F32 ? (float *)c : (float *)gemm_scratch(GEMM_SCRATCH_OUTPUT, sizeof(float) * m * n);
+    int ldo = c_type == DTYPE_F32 ? ldc : n;
+
+    if(accumulate && out != c){
+        for(int i = 0; i < m; i++){
+            dtype_convert((char *)c + (size_t)i * ldc * dtype_size(c_type), c_type, out + i * ldo, DTYPE_F32, n);
+        }
+    }
+
+    int kc_max = MIN(k, GEMM_KC);
+    float * packed_a = (float *)gemm_scratch(GEMM_SCRATCH_PACKED_A, sizeof(float) * ROUND_UP(MIN(m, GEMM_MC), GEMM_MR_F32) * kc_max);
+    float * packed_b = (float *)gemm_scratch(GEMM_SCRATCH_PACKED_B, sizeof(float) * ROUND_UP(MIN(n, GEMM_NC), GEMM_NR_F32) * kc_max);
+
+    for(int jc = 0; jc < n; jc += GEMM_NC){
+        int nc = MIN(GEMM_NC, n - jc);
+
+        for(int pc = 0; pc < k; pc += GEMM_KC){
+            int kc = MIN(GEMM_KC, k - pc);
+            int add = accumulate || pc > 0;
+
+            pack_b_f32(kc, nc, b, b_type, (long)pc * rsb + (long)jc * csb, rsb, csb, packed_b);
+
+            for(int ic = 0; ic < m; ic += GEMM_MC){
+                int mc = MIN(GEMM_MC, m - ic);
+
+                pack_a_f32(mc, kc, a, a_type, (long)ic * rsa + (long)pc * csa, rsa, csa, packed_a);
+                macro_kernel_f32(mc, nc, kc, packed_a, packed_b, out + ic * ldo + jc, ldo, add);
+            }
+        }
+    }
+
+    if(out != c){
+        for(int i = 0; i < m; i++){
+            dtype_convert(out + i * ldo, DTYPE_F32, (char *)c + (size_t)i * ldc * dtype_size(c_type), c_type, n);
+        }
+    }
+}
+
+static void gemm_f32_rows(int begin, int end, void * context){
+    gemm_job * job = (gemm_job *)context;
+
+    gemm_f32_strided_serial(end - begin, job->n, job->k, 
+        (const char *)job->a + (long)begin * job->rsa * (long)dtype_size(job->a_type), job->a_type, job->rsa, job->csa, 
+        job->b, job->b_type, job->rsb, job->csb, 
+        (char *)job->c + (long)begin * job->ldc * (long)dtype_size(job->c_type), job->c_type, job->ldc, job->accumulate
+    );
+}
+
+void gemm_f32_strided(int m, int n, int k, const void * a, dtype a_type, int rsa, int csa, const void * b, dtype b_type, int rsb, int csb, 
+    void * c, dtype c_type, int ldc, int accumulate){
+    int block = gemm_row_block(m, n, k, GEMM_MR_F32);
+
+    if(block == 0){
+        gemm_f32_strided_serial(m, n, k, a, a_type, rsa, csa, b, b_type, rsb, csb, c, c_type, ldc, accumulate);
+        return;
+    }
+
+    gemm_job job = {
+        .n = n, .k = k, 
+        .a = a, .a_type = a_type, .rsa = rsa, .csa = csa, 
+        .b = b, .b_type = b_type, .rsb = rsb, .csb = csb, 
+        .c = c, .c_type = c_type, .ldc = ldc, .accumulate = accumulate,
+    };
+    thread_pool_parallel_for(m, block, gemm_f32_rows, &job);
+}
+
+/*
+Stamps out the four row fp32 gemv for float and bfloat16 weights, y[i] is at y + i * incy
+*/
+#define DEFINE_GEMV_F32(name, T, LOAD)                                          \
+SIMD_TARGET_CLONES static void name(int m, int k, const T * a, int lda, const float * x, float * y, int incy, int accumulate){ \
+    int i = 0;                                                                  \
+    for(; i + 4 <= m; i += 4){                                                  \
+        const T * a0 = a + (size_t)i * lda;                                     \
+        const T * a1 = a0 + lda;                                                \
+        const T * a2 = a1 + lda;                                                \
+        const T * a3 = a2 + lda;                                                \
+                                                                                \
+        float acc[4][2 * GEMV_LANES] = {{0}};                                   \
+        int p = 0;                                                              \
+        for(; p + 2 * GEMV_LANES <= k; p += 2 * GEMV_LANES){                    \
+            for(int l = 0; l < 2 * GEMV_LANES; l++){                            \
+                float x_p = x[p + l];                                           \
+                acc[0][l] += LOAD(a0[p + l]) * x_p;                             \
+                acc[1][l] += LOAD(a1[p + l]) * x_p;                             \
+                acc[2][l] += LOAD(a2[p + l]) * x_p;                             \
+                acc[3][l] += LOAD(a3[p + l]) * x_p;                             \
+            }                                                                   \
+        }                                                                       \
+                                                                                \
+        for(int r = 0; r < 4; r++){                                             \
+            const T * a_row = a0 + (size_t)r * lda;                             \
+            float output = 0.0f;                                                \
+            for(int l = 0; l < 2 * GEMV_LANES; l++){                            \
+                output += acc[r][l];                                            \
+            }                                                                   \
+            for(int q = p; q < k; q++){                                         \
+                output += LOAD(a_row[q]) * x[q];                                \
+            }                                                                   \
+            float * y_i = y + (long)(i + r) * incy;                             \
+            *y_i = accumulate ? *y_i + output : output;                         \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    for(; i < m; i++){                                                          \
+        const T * a_row = a + (size_t)i * lda;                                  \
+        float output = 0.0f;                                                    \
+        for(int p = 0; p < k; p++){                                             \
+            output += LOAD(a_row[p]) * x[p];                                    \
+        }                                                                       \
+        y[(long)i * incy] = accumulate ? y[(long)i * incy] + output : output;   \
+    }                                                                           \
+}
+
+#define LOAD_FLOAT(v) (v)
+
+DEFINE_GEMV_F32(gemv_float, float, LOAD_FLOAT)
+DEFINE_GEMV_F32(gemv_bfloat16, bfloat16, bf16_to_f32)
+
+void gemv_f32(int m, int k, const void * a, dtype a_type, int lda, const void * x, dtype x_type, void * y, dtype y_type){
+    gemv_f32_strided(m, k, a, a_type, lda, x, x_type, y, y_type, 1, 0);
+}
+
+static void gemv_f32_strided(int m, int k, const void * a, dtype a_type, int lda, const void * x, dtype x_type, 
+    void * y, dtype y_type, int incy, int accumulate){
+    float * x_f32 = (float *)x;
+    float * y_f32 = (float *)y;
+    int inc_f32 = incy;
+
+    if(x_type != DTYPE_F32){
+        x_f32 = (float *)gemm_scratch(GEMM_SCRATCH_VECTOR_X, sizeof(float) * k);
+        dtype_convert(x, x_type, x_f32, DTYPE_F32, k);
+    }
+
+    // a narrow y goes through a contiguous float copy
+    if(y_type != DTYPE_F32){
+        y_f32 = (float *)gemm_scratch(GEMM_SCRATCH_VECTOR_Y, sizeof(float) * m);
+        inc_f32 = 1;
+
+        for(int i = 0; i < m && accumulate; i++){
+            y_f32[i] = dtype_get(y, y_type, (size_t)i * incy);
+        }
+    }
+
+    if(a_type == DTYPE_BF16){
+        gemv_bfloat16(m, k, a, lda, x_f32, y_f32, inc_f32, accumulate);
+    }else{
+        gemv_float(m, k, a, lda, x_f32, y_f32, inc_f32, accumulate);
+    }
+
+    if(y_f32 != y){
+        for(int i = 0; i < m; i++){
+            dtype_set(y, y_type, (size_t)i * incy, y_f32[i]);
+        }
+    }
+}
\ No newline at end of file
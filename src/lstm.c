@@ -1,21 +1,22 @@
 #include "lstm.h"
+#include "profile.h"
 
 static inline tensor ** create_tensor_array(int size){
     tensor ** array = (tensor **)SAFE_MALLOC(sizeof(tensor *) * size);
     return array;
 }
 
-static inline void allocate_tensor_memory(tensor ** array, int * shape, int start, int len){
+static inline void allocate_tensor_memory(tensor ** array, int * shape, int start, int len, dtype type){
     assert(start < len);
 
     for(int i = start; i < len; i++){
-        array[i] = tensor_init(2, shape);
+        array[i] = tensor_init_with_dtype(2, shape, type);
     }   
 }
 
-static inline tensor ** allocate_tensor_array(int size, int * shape){
+static inline tensor ** allocate_tensor_array(int size, int * shape, dtype type){
     tensor ** array = create_tensor_array(size);
-    allocate_tensor_memory(array, shape, 0, size);
+    allocate_tensor_memory(array, shape, 0, size, type);
     return array;
 }
 
@@ -27,104 +28,1324 @@ static inline void tensor_array_cleanup(tensor ** array, int size){
     SAFE_FREE(array);
 }
 
-LSTM * lstm_init(int input_size, int hidden_size, int output_size, int sequence_length){
-    LSTM * lstm = (LSTM *)SAFE_MALLOC(sizeof(LSTM));
+/*
+Storage type of the weights, narrow modes keep weights in f32 or bf16
+*/
+static inline dtype lstm_weight_dtype(int flags){
+    if(flags & LSTM_BFLOAT16){
+        return DTYPE_BF16;
+    }
+
+    return (flags & LSTM_FLOAT32) ? DTYPE_F32 : DTYPE_F64;
+}
+
+/*
+Storage type of the activations, bf16 weights still accumulate and carry state in f32
+*/
+static inline dtype lstm_state_dtype(int flags){
+    return (flags & (LSTM_FLOAT32 | LSTM_BFLOAT16)) ? DTYPE_F32 : DTYPE_F64;
+}
+
+static inline tensor * weight_init(int * shape, int flags){
+    return tensor_fill_rand(tensor_init_with_dtype(2, shape, lstm_weight_dtype(flags)));
+}
+
+static inline void init_fused_views(lstm_weights * weights){
+    int hidden_size = weights->hidden_size;
+
+    weights->Wf = tensor_slice(tensor_view(weights->W), weights->W, 0, 0, hidden_size);
+    weights->Wi = tensor_slice(tensor_view(weights->W), weights->W, 0, hidden_size, hidden_size);
+    weights->Wc = tensor_slice(tensor_view(weights->W), weights->W, 0, 2 * hidden_size, hidden_size);
+    weights->Wo = tensor_slice(tensor_view(weights->W), weights->W, 0, 3 * hidden_size, hidden_size);
+}
+
+/*
+Gate weight blocks the split views are taken from, W alone with LSTM_FUSED_GATES
+*/
+static inline int lstm_gate_blocks(lstm_weights * weights){
+    return (weights->flags & LSTM_FUSED_GATES) ? 1 : 4;
+}
+
+static inline void init_split_views(lstm_weights * weights){
+    int hidden_size = weights->hidden_size;
+    tensor * blocks[4] = {weights->Wf, weights->Wi, weights->Wc, weights->Wo};
+
+    if(weights->flags & LSTM_FUSED_GATES){
+        blocks[0] = weights->W;
+    }
+
+    // per row scales of int8 blocks carry over to their column views
+    for(int g = 0; g < lstm_gate_blocks(weights); g++){
+        weights->Wh[g] = tensor_slice(tensor_view(blocks[g]), blocks[g], 1, 0, hidden_size);
+        weights->Wx[g] = tensor_slice(tensor_view(blocks[g]), blocks[g], 1, hidden_size, weights->input_size - hidden_size);
+    }
+}
+
+static void lstm_weights_free(const struct ref * ref){
+    lstm_weights * weights = container_of(ref, lstm_weights, refcount);
+
+    for(int g = 0; g < 4; g++){
+        tensor_cleanup(weights->Wh[g]);
+        tensor_cleanup(weights->Wx[g]);
+    }
+
+    tensor_cleanup(weights->Wf);
+    tensor_cleanup(weights->Wi);
+    tensor_cleanup(weights->Wo);
+    tensor_cleanup(weights->Wy);
+    tensor_cleanup(weights->Wc);
+    tensor_cleanup(weights->W);
+
+    SAFE_FREE(weights);
+}
+
+/*
+Empty weights holding one reference, the caller fills in the tensors
+*/
+static lstm_weights * lstm_weights_alloc(int input_size, int hidden_size, int output_size, int flags){
+    lstm_weights * weights = (lstm_weights *)SAFE_MALLOC(sizeof(lstm_weights));
+
+    weights->input_size = input_size;
+    weights->hidden_size = hidden_size;
+    weights->output_size = output_size;
+    weights->flags = flags & (LSTM_FUSED_GATES | LSTM_FLOAT32 | LSTM_BFLOAT16 | LSTM_INT8);
+
+    weights->W = NULL;
+    weights->Wf = NULL;
+    weights->Wi = NULL;
+    weights->Wo = NULL;
+    weights->Wc = NULL;
+    weights->Wy = NULL;
+
+    for(int g = 0; g < 4; g++){
+        weights->Wh[g] = NULL;
+        weights->Wx[g] = NULL;
+    }
+
+    weights->refcount.free = lstm_weights_free;
+    atomic_init(&weights->refcount.count, 1);
+
+    return weights;
+}
+
+lstm_weights * lstm_weights_init(int input_size, int hidden_size, int output_size, int flags){
+    TENSOR_CHECK((flags & LSTM_FLOAT32) && (flags & LSTM_BFLOAT16), "LSTM_FLOAT32 and LSTM_BFLOAT16 are exclusive");
+    TENSOR_CHECK(flags & LSTM_INT8, "Weights are quantized from floating point ones, see lstm_quantize");
+    TENSOR_CHECK(input_size <= hidden_size, "Input size %d must include the hidden size %d", input_size, hidden_size);
+    TENSOR_CHECK(output_size < 0, "Output size should not be negative, got %d", output_size);
+
+    lstm_weights * weights = lstm_weights_alloc(input_size, hidden_size, output_size, flags);
 
     int weight_shape[2] = {hidden_size, input_size};
+    int fused_shape[2] = {4 * hidden_size, input_size};
     int output_shape[2] = {output_size, hidden_size};
 
+    if(flags & LSTM_FUSED_GATES){
+        weights->W = weight_init(fused_shape, flags);
+        init_fused_views(weights);
+    }else{
+        weights->Wf = weight_init(weight_shape, flags);
+        weights->Wi = weight_init(weight_shape, flags);
+        weights->Wc = weight_init(weight_shape, flags);
+        weights->Wo = weight_init(weight_shape, flags);
+    }
+
+    if(output_size > 0){
+        weights->Wy = weight_init(output_shape, flags);
+    }
+
+    init_split_views(weights);
+
+    return weights;
+}
+
+lstm_weights * lstm_weights_from_tensors(int flags, tensor * W, tensor * gates[4], tensor * Wy){
+    TENSOR_CHECK((flags & LSTM_FLOAT32) && (flags & LSTM_BFLOAT16), "LSTM_FLOAT32 and LSTM_BFLOAT16 are exclusive");
+
+    tensor * first = (flags & LSTM_FUSED_GATES) ? W : (gates != NULL ? gates[0] : NULL);
+    TENSOR_CHECK(first == NULL, "Gate weights undefined");
+
+    int hidden_size = (flags & LSTM_FUSED_GATES) ? tensor_shape(W)[0] / 4 : tensor_shape(first)[0];
+    int input_size = tensor_shape(first)[1];
+    int output_size = Wy != NULL ? tensor_shape(Wy)[0] : 0;
+
+    dtype type = (flags & LSTM_INT8) ? DTYPE_I8 : lstm_weight_dtype(flags);
+
+    if(flags & LSTM_FUSED_GATES){
+        TENSOR_CHECK(tensor_shape(W)[0] % 4 != 0 || tensor_dtype(W) != type, 
+            "Fused gate weights should be [4H x %d] %s", input_size, dtype_name(type)
+        );
+    }else{
+        for(int i = 0; i < 4; i++){
+            TENSOR_CHECK(gates[i] == NULL || tensor_shape(gates[i])[0] != hidden_size || tensor_shape(gates[i])[1] != input_size || tensor_dtype(gates[i]) != type, 
+                "Gate weights should be [%d x %d] %s", hidden_size, input_size, dtype_name(type)
+            );
+        }
+    }
+
+    TENSOR_CHECK(Wy != NULL && (tensor_shape(Wy)[1] != hidden_size || tensor_dtype(Wy) != type), 
+        "Output weights should be [%d x %d] %s", output_size, hidden_size, dtype_name(type)
+    );
+    TENSOR_CHECK(input_size <= hidden_size, "Input size %d must include the hidden size %d", input_size, hidden_size);
+
+    lstm_weights * weights = lstm_weights_alloc(input_size, hidden_size, output_size, flags);
+
+    if(flags & LSTM_FUSED_GATES){
+        weights->W = W;
+        init_fused_views(weights);
+    }else{
+        weights->Wf = gates[0];
+        weights->Wi = gates[1];
+        weights->Wc = gates[2];
+        weights->Wo = gates[3];
+    }
+
+    weights->Wy = Wy;
+    init_split_views(weights);
+
+    return weights;
+}
+
+lstm_weights * lstm_weights_retain(lstm_weights * weights){
+    TENSOR_CHECK(weights == NULL, "Weights undefined");
+
+    ref_inc(&weights->refcount);
+
+    return weights;
+}
+
+void lstm_weights_release(lstm_weights * weights){
+    if(weights == NULL){
+        return;
+    }
+
+    ref_dec(&weights->refcount);
+}
+
+/*
+Number of timesteps whose activations are kept, inference mode only keeps the current one
+and checkpointed training one segment
+*/
+static inline int lstm_history(LSTM * lstm){
+    if(lstm->flags & LSTM_INFERENCE){
+        return 1;
+    }
+
+    return (lstm->flags & LSTM_CHECKPOINT) ? lstm->checkpoint_interval : lstm->sequence_length;
+}
+
+/*
+lstm_forward_batch returns every output, also when the rest of the history is a segment
+*/
+static inline int lstm_output_count(LSTM * lstm){
+    return (lstm->flags & LSTM_CHECKPOINT) ? lstm->sequence_length : lstm_history(lstm);
+}
+
+static inline int lstm_checkpoint_count(LSTM * lstm){
+    return (lstm->flags & LSTM_CHECKPOINT) ? (lstm->sequence_length + lstm->checkpoint_interval - 1) / lstm->checkpoint_interval : 0;
+}
+
+/*
+The gates always live in one block so fused and unfused weights share the step
+*/
+static void lstm_cell_init(lstm_cell * cell, int input_size, int hidden_size, int batch_size, dtype type){
+    int concat_shape[2] = {input_size, batch_size};
+    int gates_shape[2] = {4 * hidden_size, batch_size};
+
+    cell->concat_input = tensor_init_with_dtype(2, concat_shape, type);
+    cell->gates = tensor_init_with_dtype(2, gates_shape, type);
+    cell->forget_gate = tensor_slice(tensor_view(cell->gates), cell->gates, 0, 0, hidden_size);
+    cell->input_gate = tensor_slice(tensor_view(cell->gates), cell->gates, 0, hidden_size, hidden_size);
+    cell->candidate_gate = tensor_slice(tensor_view(cell->gates), cell->gates, 0, 2 * hidden_size, hidden_size);
+    cell->output_gate = tensor_slice(tensor_view(cell->gates), cell->gates, 0, 3 * hidden_size, hidden_size);
+}
+
+static void lstm_cell_cleanup(lstm_cell * cell){
+    tensor_cleanup(cell->forget_gate);
+    tensor_cleanup(cell->input_gate);
+    tensor_cleanup(cell->candidate_gate);
+    tensor_cleanup(cell->output_gate);
+    tensor_cleanup(cell->gates);
+    tensor_cleanup(cell->concat_input);
+}
+
+/*
+Allocates the per timestep activations, every state tensor holds one column per sequence in the batch.
+In inference mode this is a single h/c pair updated in place and a single output scratch.
+
+h_0 and x_t are the two row blocks of the concat, lstm_infer steps in place through h_0 and only gathers x_t.
+lstm_forward_batch projects the inputs of a whole segment at once, its h_t never enter a concat and
+the pre-activations are the only gate values kept per step
+*/
+static void lstm_state_init(LSTM * lstm, int batch_size){
+    arena * memory = arena_current();
+    if(memory != NULL){
+        lstm->state_start = arena_position(memory);
+    }
+
+    lstm->batch_size = batch_size;
+    lstm->generation++;
+
+    dtype type = lstm_state_dtype(lstm->flags);
+    int steps = lstm_history(lstm);
+    int hidden_size = lstm->hidden_size;
+
+    lstm_cell_init(&lstm->cell, lstm->input_size, hidden_size, batch_size, type);
+    tensor * concat = lstm->cell.concat_input;
+    lstm->step_input = tensor_slice(tensor_view(concat), concat, 0, hidden_size, lstm->input_size - hidden_size);
+
+    int init_shape[2] = {hidden_size, batch_size};
+    lstm->hidden_states = create_tensor_array(steps + 1);
+    lstm->hidden_states[0] = tensor_slice(tensor_view(concat), concat, 0, 0, hidden_size);
+
+    lstm->cell_states = create_tensor_array(steps + 1);
+    lstm->cell_states[0] = tensor_init_with_dtype(2, init_shape, type);
+
+    if(lstm->flags & LSTM_INFERENCE){
+        // the step reads h and c before it overwrites them, so both slots can share storage
+        lstm->hidden_states[1] = tensor_view(lstm->hidden_states[0]);
+        lstm->cell_states[1] = tensor_view(lstm->cell_states[0]);
+    }else{
+        allocate_tensor_memory(lstm->hidden_states, init_shape, 1, steps + 1, type);
+        allocate_tensor_memory(lstm->cell_states, init_shape, 1, steps + 1, type);
+    }
+
+    tensor_fill(lstm->hidden_states[0], 0);
+    tensor_fill(lstm->cell_states[0], 0);
+
+    int pre_activations_shape[2] = {4 * hidden_size, steps * batch_size};
+    int segment_inputs_shape[2] = {steps * batch_size, lstm->input_size - hidden_size};
+    int segment_hidden_shape[2] = {hidden_size, steps * batch_size};
+    int segment_outputs_shape[2] = {lstm->output_size, steps * batch_size};
+    int history = !(lstm->flags & LSTM_INFERENCE);
+    lstm->pre_activations = history ? tensor_init_with_dtype(2, pre_activations_shape, type) : NULL;
+    lstm->segment_inputs = history ? tensor_init_with_dtype(2, segment_inputs_shape, type) : NULL;
+    lstm->segment_hidden = history ? tensor_init_with_dtype(2, segment_hidden_shape, type) : NULL;
+    lstm->segment_outputs = history ? tensor_init_with_dtype(2, segment_outputs_shape, type) : NULL;
+
+    int output_shape[2] = {lstm->output_size, batch_size};
+    lstm->outputs = allocate_tensor_array(lstm_output_count(lstm), output_shape, type);
+    lstm->output_view = tensor_view(lstm->outputs[0]);
+
+    int checkpoints = lstm_checkpoint_count(lstm);
+    lstm->checkpoint_hidden = checkpoints > 0 ? allocate_tensor_array(checkpoints, init_shape, type) : NULL;
+    lstm->checkpoint_cells = checkpoints > 0 ? allocate_tensor_array(checkpoints, init_shape, type) : NULL;
+
+    if(memory != NULL){
+        lstm->state_end = arena_position(memory);
+    }
+}
+
+static void lstm_state_cleanup(LSTM * lstm){
+    int steps = lstm_history(lstm);
+
+    tensor_array_cleanup(lstm->hidden_states, steps + 1);
+    tensor_array_cleanup(lstm->cell_states, steps + 1);
+
+    tensor_cleanup(lstm->step_input);
+    lstm_cell_cleanup(&lstm->cell);
 
-    lstm->hidden_size = hidden_size;
+    tensor_array_cleanup(lstm->outputs, lstm_output_count(lstm));
+    tensor_cleanup(lstm->output_view);
+
+    if(lstm->checkpoint_hidden != NULL){
+        tensor_array_cleanup(lstm->checkpoint_hidden, lstm_checkpoint_count(lstm));
+        tensor_array_cleanup(lstm->checkpoint_cells, lstm_checkpoint_count(lstm));
+    }
+
+    tensor_cleanup(lstm->pre_activations);
+    tensor_cleanup(lstm->segment_inputs);
+    tensor_cleanup(lstm->segment_hidden);
+    tensor_cleanup(lstm->segment_outputs);
+}
+
+LSTM * lstm_init(int input_size, int hidden_size, int output_size, int sequence_length){
+    return lstm_init_with_flags(input_size, hidden_size, output_size, sequence_length, LSTM_DEFAULT);
+}
+
+LSTM * lstm_init_with_flags(int input_size, int hidden_size, int output_size, int sequence_length, int flags){
+    lstm_weights * weights = lstm_weights_init(input_size, hidden_size, output_size, flags & ~LSTM_INT8);
+
+    LSTM * lstm = lstm_init_with_weights(weights, sequence_length, flags);
+    lstm_weights_release(weights);
+
+    if(flags & LSTM_INT8){
+        lstm_quantize(lstm);
+    }
+
+    return lstm;
+}
+
+/*
+About sqrt(T) steps per segment balances the segment against the checkpoints
+*/
+static inline int lstm_default_checkpoint_interval(int sequence_length){
+    int interval = 1;
+    while(interval * interval < sequence_length){
+        interval++;
+    }
+
+    return interval;
+}
+
+LSTM * lstm_init_with_weights(lstm_weights * weights, int sequence_length, int flags){
+    TENSOR_CHECK(weights == NULL, "Weights undefined");
+    TENSOR_CHECK(weights->Wy == NULL, "A model needs weights with an output projection");
+
+    LSTM * lstm = (LSTM *)SAFE_MALLOC(sizeof(LSTM));
+
+    lstm->input_size = weights->input_size;
+    lstm->hidden_size = weights->hidden_size;
+    lstm->output_size = weights->output_size;
     lstm->sequence_length = sequence_length;
+    TENSOR_CHECK((flags & LSTM_INFERENCE) && (flags & LSTM_CHECKPOINT), "LSTM_INFERENCE keeps no history to checkpoint");
+
+    lstm->flags = weights->flags | (flags & (LSTM_INFERENCE | LSTM_CHECKPOINT));
+    lstm->arena = NULL;
+    lstm->backend = NULL;
+    lstm->weights = lstm_weights_retain(weights);
+    lstm->checkpoint_interval = lstm_default_checkpoint_interval(sequence_length);
+    lstm->generation = 0;
+    lstm->inputs = NULL;
+
+    lstm_state_init(lstm, 1);
+
+    return lstm;
+}
+
+/*
+Makes later allocations land in the arena of the model, also while lstm_init_in_arena is still building it
+*/
+static inline arena * lstm_enter_arena(LSTM * self){
+    return arena_set_current(self->arena != NULL ? self->arena : arena_current());
+}
+
+/*
+Drops the state tensors, in the arena of the model their bytes are rewound for the next lstm_state_init
+*/
+static void lstm_state_release(LSTM * self){
+    TENSOR_CHECK(self->arena != NULL && !arena_mark_equal(arena_position(self->arena), self->state_end), 
+        "The arena of the model was allocated from after its state, the state can no longer be replaced"
+    );
+
+    lstm_state_cleanup(self);
+
+    if(self->arena != NULL){
+        arena_rewind(self->arena, self->state_start);
+    }
+}
+
+void lstm_set_backend(LSTM * self, backend_kind kind){
+    self->backend = backend_for(kind);
+}
+
+/*
+Dispatches the tensor ops of the calling thread to the backend of a model until the previous one is restored
+*/
+static inline const backend_ops * lstm_enter_backend(const backend_ops * backend){
+    return backend_set_current(backend != NULL ? backend : backend_get());
+}
+
+void lstm_set_batch_size(LSTM * self, int batch_size){
+    TENSOR_CHECK(batch_size < 1, "Batch size should at least be 1, got %d", batch_size);
+
+    if(self->batch_size == batch_size){
+        return;
+    }
+
+    arena * previous = lstm_enter_arena(self);
+
+    lstm_state_release(self);
+    lstm_state_init(self, batch_size);
+
+    arena_set_current(previous);
+}
+
+void lstm_set_checkpoint_interval(LSTM * self, int interval){
+    TENSOR_CHECK(self->flags & LSTM_INFERENCE, "LSTM_INFERENCE keeps no history to checkpoint");
+    TENSOR_CHECK(interval < 0 || interval > self->sequence_length, 
+        "Checkpoint interval should be in [0, %d], got %d", self->sequence_length, interval
+    );
+
+    arena * previous = lstm_enter_arena(self);
 
-    lstm->Wf = tensor_rand_(weight_shape);
-    lstm->Wi = tensor_rand_(weight_shape);
-    lstm->Wc = tensor_rand_(weight_shape);
-    lstm->Wo = tensor_rand_(weight_shape);
-    lstm->Wy = tensor_rand_(output_shape);
+    lstm_state_release(self);
+    self->flags |= LSTM_CHECKPOINT;
+    self->checkpoint_interval = interval > 0 ? interval : lstm_default_checkpoint_interval(self->sequence_length);
+    lstm_state_init(self, self->batch_size);
 
+    arena_set_current(previous);
+}
+
+/*
+Upper bound of the bytes lstm_init_with_flags takes, headers and alignment included
+*/
+static size_t lstm_arena_size(int input_size, int hidden_size, int output_size, int sequence_length, int flags){
+    size_t weight_elements = (size_t)4 * hidden_size * input_size + (size_t)output_size * hidden_size;
+    size_t state_elements = (size_t)2 * (sequence_length + 1) * hidden_size
+        + (size_t)sequence_length * (input_size + 5 * hidden_size + 2 * output_size) + 2 * input_size + 4 * hidden_size;
 
-    int init_shape[2] = {hidden_size, 1};
-    lstm->hidden_states = create_tensor_array(lstm->sequence_length + 1);
-    lstm->hidden_states[0] = tensor_zeros(init_shape);
-    allocate_tensor_memory(lstm->hidden_states, init_shape, 1, lstm->sequence_length + 1);
+    // tensor header, Data header and payload per tensor, each padded to a cache line
+    size_t tensors = (size_t)4 * sequence_length + 44;
 
-    lstm->cell_states = create_tensor_array(lstm->sequence_length + 1);
-    lstm->cell_states[0] = tensor_zeros(init_shape);
-    allocate_tensor_memory(lstm->cell_states, init_shape, 1, lstm->sequence_length + 1);
+    return weight_elements * dtype_size(lstm_weight_dtype(flags)) + state_elements * dtype_size(lstm_state_dtype(flags))
+        + tensors * 3 * 2 * ARENA_ALIGNMENT;
+}
 
-    int concat_shape[2] = {input_size, 1};
-    lstm->concat_inputs = allocate_tensor_array(lstm->sequence_length, concat_shape);
+LSTM * lstm_init_in_arena(int input_size, int hidden_size, int output_size, int sequence_length, int flags){
+    arena * owner = arena_init(lstm_arena_size(input_size, hidden_size, output_size, sequence_length, flags));
+    arena * previous = arena_set_current(owner);
 
+    LSTM * lstm = lstm_init_with_flags(input_size, hidden_size, output_size, sequence_length, flags & ~LSTM_INT8);
+    lstm->arena = owner;
 
-    lstm->forget_gates = allocate_tensor_array(lstm->sequence_length, init_shape);
-    lstm->input_gates = allocate_tensor_array(lstm->sequence_length, init_shape);
-    lstm->candidate_gates = allocate_tensor_array(lstm->sequence_length, init_shape);
-    lstm->output_gates = allocate_tensor_array(lstm->sequence_length, init_shape);
+    // quantized once the model owns the arena, so the state moves above the int8 weights
+    if(flags & LSTM_INT8){
+        lstm_quantize(lstm);
+    }
 
-    lstm->outputs = allocate_tensor_array(lstm->sequence_length, init_shape);
+    arena_set_current(previous);
 
     return lstm;
 }
 
-tensor ** lstm_forward(LSTM * self, tensor * input){
-    int * input_shape = tensor_shape(input);
+void lstm_quantize(LSTM * self){
+    if(self->flags & LSTM_INT8){
+        return;
+    }
+
+    arena * previous = lstm_enter_arena(self);
+
+    if(self->arena != NULL){
+        lstm_state_release(self);
+    }
+
+    // weights are never written once shared, the model swaps its reference to a quantized copy
+    lstm_weights * weights = self->weights;
+    lstm_weights * quantized = lstm_weights_alloc(weights->input_size, weights->hidden_size, weights->output_size, weights->flags | LSTM_INT8);
+
+    if(weights->flags & LSTM_FUSED_GATES){
+        // per row scales of the fused block are the per row scales of each gate
+        quantized->W = tensor_quantize(weights->W);
+        init_fused_views(quantized);
+    }else{
+        quantized->Wf = tensor_quantize(weights->Wf);
+        quantized->Wi = tensor_quantize(weights->Wi);
+        quantized->Wc = tensor_quantize(weights->Wc);
+        quantized->Wo = tensor_quantize(weights->Wo);
+    }
+
+    quantized->Wy = tensor_quantize(weights->Wy);
+    init_split_views(quantized);
+
+    lstm_weights_release(weights);
+    self->weights = quantized;
+    self->flags |= LSTM_INT8;
+
+    // in an arena the state was rewound before the int8 weights were allocated, it goes back on top of them
+    if(self->arena != NULL){
+        lstm_state_init(self, self->batch_size);
+    }
+
+    arena_set_current(previous);
+}
+
+lstm_quant_report lstm_quantize_calibrate(LSTM * self, tensor * inputs, int batch){
+    TENSOR_CHECK(self->flags & LSTM_INT8, "LSTM is already quantized");
+
+    tensor ** outputs = lstm_forward_batch(self, inputs, batch);
+
+    tensor ** reference = create_tensor_array(self->sequence_length);
+    for(int i = 0; i < self->sequence_length; i++){
+        reference[i] = tensor_astype(outputs[i], DTYPE_F64);
+    }
+
+    lstm_quantize(self);
+    outputs = lstm_forward_batch(self, inputs, batch);
+
+    lstm_quant_report report = {0};
+    int count = 0;
 
     for(int i = 0; i < self->sequence_length; i++){
-        tensor * subtensor = tensor_init(2, input_shape);
-        
-        tensor_select(subtensor, input, i);
-        tensor_concat(self->concat_inputs[i], self->hidden_states[i], subtensor);
+        tensor * quantized = tensor_astype(outputs[i], DTYPE_F64);
+        double * expected = tensor_data(reference[i]);
+        double * actual = tensor_data(quantized);
+        int length = self->output_size * self->batch_size;
+
+        for(int j = 0; j < length; j++){
+            double error = actual[j] > expected[j] ? actual[j] - expected[j] : expected[j] - actual[j];
+            double magnitude = expected[j] < 0 ? -expected[j] : expected[j];
+
+            report.mean_abs_error += error;
+            report.max_abs_error = error > report.max_abs_error ? error : report.max_abs_error;
+            report.max_abs_output = magnitude > report.max_abs_output ? magnitude : report.max_abs_output;
+        }
+
+        count += length;
+        tensor_cleanup(quantized);
+    }
+
+    report.mean_abs_error /= count;
+
+    tensor_array_cleanup(reference, self->sequence_length);
+
+    return report;
+}
+
+tensor ** lstm_forward(LSTM * self, tensor * input){
+    return lstm_forward_batch(self, input, 1);
+}
+
+/*
+Rows per sequence of a batched input, sequence b occupies rows [b * rows, (b + 1) * rows)
+*/
+static inline int lstm_batch_rows(tensor * inputs, int batch){
+    int * input_shape = tensor_shape(inputs);
+
+    TENSOR_CHECK(batch < 1, "Batch size should at least be 1, got %d", batch);
+    TENSOR_CHECK(input_shape[0] % batch != 0, "Input rows %d not divisible by batch %d", input_shape[0], batch);
+
+    return input_shape[0] / batch;
+}
+
+static inline void lstm_reset_state(LSTM * self){
+    tensor_fill(self->hidden_states[0], 0);
+    tensor_fill(self->cell_states[0], 0);
+}
+
+/*
+Bytes of a matrix and flops of its product with the concat, only evaluated when profiling
+*/
+static inline double lstm_bytes(tensor * t){
+    return (double)tensor_shape(t)[0] * tensor_shape(t)[1] * dtype_size(tensor_dtype(t));
+}
 
-        tensor_mat_mul(self->forget_gates[i], self->Wf, self->concat_inputs[i]);
-        tensor_sigmoid_(self->forget_gates[i]);
+static inline double lstm_gate_flops(tensor * weight, tensor * gate, double activation_flops){
+    return (2.0 * tensor_shape(weight)[1] + activation_flops) * tensor_shape(gate)[0] * tensor_shape(gate)[1];
+}
 
-        tensor_mat_mul(self->input_gates[i], self->Wi, self->concat_inputs[i]);
-        tensor_sigmoid_(self->input_gates[i]);
+#define LSTM_PROFILE_GATE(event, weight, x, gate, activation_flops) \
+    PROFILE_END(event, lstm_gate_flops(weight, gate, activation_flops), lstm_bytes(weight) + lstm_bytes(x) + lstm_bytes(gate))
 
-        tensor_mat_mul(self->candidate_gates[i], self->Wc, self->concat_inputs[i]);
-        tensor_tanh_(self->candidate_gates[i]);
+/*
+c_next = f * c_prev + i * g and h_next = o * tanh(c_next) from the activated gates of cell
+*/
+static void lstm_cell_update(lstm_cell * cell, tensor * c_prev, tensor * h_next, tensor * c_next){
+    // h_next holds i * g until it is overwritten, so c_prev is never clobbered
+    PROFILE_BEGIN(PROFILE_LSTM_CELL_UPDATE);
+    tensor_mul(h_next, cell->input_gate, cell->candidate_gate);
+    tensor_mul(c_next, cell->forget_gate, c_prev);
+    tensor_plus_(c_next, h_next);
 
-        tensor_mat_mul(self->output_gates[i], self->Wo, self->concat_inputs[i]);
-        tensor_sigmoid_(self->output_gates[i]);
+    tensor_tanh(h_next, c_next);
+    tensor_mul_(h_next, cell->output_gate);
+    // 4 point-wise ops and a tanh per element, the 4 gates and c_prev read, h and c written
+    PROFILE_END(PROFILE_LSTM_CELL_UPDATE, (4.0 + PROFILE_TANH_FLOPS) * tensor_shape(h_next)[0] * tensor_shape(h_next)[1], 
+        lstm_bytes(cell->input_gate) * 4 + lstm_bytes(c_prev) + lstm_bytes(h_next) + lstm_bytes(c_next)
+    );
+}
 
-        tensor_mul(self->cell_states[i], self->forget_gates[i], self->cell_states[i]);
-        tensor_mul(self->cell_states[i + 1], self->input_gates[i], self->candidate_gates[i]);
-        tensor_plus(self->cell_states[i + 1], self->cell_states[i + 1], self->cell_states[i]);
+/*
+One timestep on prepared concat inputs. h_next and c_next may alias h_prev and c_prev:
+h_prev is only read by the concat before the cell runs and c_prev is updated element-wise
+*/
+static void lstm_cell_forward(lstm_weights * self, lstm_cell * cell, tensor * c_prev, tensor * h_next, tensor * c_next, tensor * output){
+    if(self->flags & LSTM_FUSED_GATES){
+        // one [4H x I] mat-vec for all gates with the activations fused into its epilogue
+        PROFILE_BEGIN(PROFILE_LSTM_GATES);
+        tensor_mat_mul_gates(cell->gates, self->W, cell->concat_input);
+        LSTM_PROFILE_GATE(PROFILE_LSTM_GATES, self->W, cell->concat_input, cell->gates, PROFILE_GATE_FLOPS);
+    }else{
+        PROFILE_BEGIN(PROFILE_LSTM_FORGET_GATE);
+        tensor_mat_mul(cell->forget_gate, self->Wf, cell->concat_input);
+        tensor_sigmoid_(cell->forget_gate);
+        LSTM_PROFILE_GATE(PROFILE_LSTM_FORGET_GATE, self->Wf, cell->concat_input, cell->forget_gate, PROFILE_SIGMOID_FLOPS);
 
-        tensor_tanh(self->hidden_states[i + 1], self->cell_states[i + 1]);
-        tensor_mul(self->hidden_states[i + 1], self->output_gates[i], self->hidden_states[i + 1]);
+        PROFILE_BEGIN(PROFILE_LSTM_INPUT_GATE);
+        tensor_mat_mul(cell->input_gate, self->Wi, cell->concat_input);
+        tensor_sigmoid_(cell->input_gate);
+        LSTM_PROFILE_GATE(PROFILE_LSTM_INPUT_GATE, self->Wi, cell->concat_input, cell->input_gate, PROFILE_SIGMOID_FLOPS);
 
-        tensor_mat_mul(self->outputs[i], self->Wy, self->hidden_states[i+1]);
+        PROFILE_BEGIN(PROFILE_LSTM_CANDIDATE_GATE);
+        tensor_mat_mul(cell->candidate_gate, self->Wc, cell->concat_input);
+        tensor_tanh_(cell->candidate_gate);
+        LSTM_PROFILE_GATE(PROFILE_LSTM_CANDIDATE_GATE, self->Wc, cell->concat_input, cell->candidate_gate, PROFILE_TANH_FLOPS);
 
-        tensor_cleanup(subtensor);
+        PROFILE_BEGIN(PROFILE_LSTM_OUTPUT_GATE);
+        tensor_mat_mul(cell->output_gate, self->Wo, cell->concat_input);
+        tensor_sigmoid_(cell->output_gate);
+        LSTM_PROFILE_GATE(PROFILE_LSTM_OUTPUT_GATE, self->Wo, cell->concat_input, cell->output_gate, PROFILE_SIGMOID_FLOPS);
     }
 
+    lstm_cell_update(cell, c_prev, h_next, c_next);
+
+    // layers feeding another layer consume h directly
+    if(output != NULL){
+        PROFILE_BEGIN(PROFILE_LSTM_PROJECTION);
+        tensor_mat_mul(output, self->Wy, h_next);
+        PROFILE_END(PROFILE_LSTM_PROJECTION, 2.0 * tensor_shape(self->Wy)[1] * tensor_shape(output)[0] * tensor_shape(output)[1], 
+            lstm_bytes(self->Wy) + lstm_bytes(h_next) + lstm_bytes(output)
+        );
+    }
+}
+
+/*
+Advances every sequence by one timestep in place: reads step of the input and h/c of the first slot, writes them back.
+output receives the projection
+*/
+static void lstm_cell_step(LSTM * self, tensor * inputs, int rows, int step, tensor * output){
+    // h_prev already sits in the upper rows of the concat, only x_t is gathered
+    PROFILE_BEGIN(PROFILE_LSTM_CONCAT);
+    tensor_select_batch(self->step_input, inputs, step, rows);
+    PROFILE_END(PROFILE_LSTM_CONCAT, 0, 2 * lstm_bytes(self->step_input));
+
+    lstm_cell_forward(self->weights, &self->cell, self->cell_states[0], self->hidden_states[0], self->cell_states[0], output);
+}
+
+/*
+View of columns [start, start + length) of src, NULL for a NULL src
+*/
+static inline tensor * lstm_columns(tensor * src, int start, int length){
+    return src != NULL ? tensor_slice(tensor_view(src), src, 1, start, length) : NULL;
+}
+
+/*
+Transposed view of columns [start, start + length) of src
+*/
+static inline tensor * lstm_transposed_columns(tensor * src, int start, int length){
+    tensor * t = lstm_columns(src, start, length);
+    return tensor_transpose(t, t);
+}
+
+/*
+Copies the [rows x batch] tensors of count steps side by side, step t into columns [t * batch, (t + 1) * batch) of all
+*/
+static void lstm_gather_steps(tensor * all, tensor ** steps, int count, int batch){
+    tensor * column = tensor_view(all);
+
+    for(int t = 0; t < count; t++){
+        tensor_slice(column, all, 1, t * batch, batch);
+        tensor_convert(column, steps[t]);
+    }
+
+    tensor_cleanup(column);
+}
+
+/*
+Inverse of lstm_gather_steps
+*/
+static void lstm_scatter_steps(tensor ** steps, tensor * all, int count, int batch){
+    tensor * column = tensor_view(all);
+
+    for(int t = 0; t < count; t++){
+        tensor_convert(steps[t], tensor_slice(column, all, 1, t * batch, batch));
+    }
+
+    tensor_cleanup(column);
+}
+
+/*
+[length * batch x features] input rows of steps [start, start + length), step major: row t * batch + b is step
+start + t of sequence b. A view of the rows for a single sequence of the right dtype, otherwise a view of
+segment_inputs the rows are gathered into
+*/
+static tensor * lstm_segment_inputs(LSTM * self, tensor * inputs, int rows, int start, int length){
+    int batch = self->batch_size;
+    if(batch == 1 && tensor_dtype(inputs) == tensor_dtype(self->segment_inputs)){
+        return tensor_slice(tensor_view(inputs), inputs, 0, start, length);
+    }
+
+    tensor * segment = tensor_slice(tensor_view(self->segment_inputs), self->segment_inputs, 0, 0, length * batch);
+    tensor * row = tensor_view(segment);
+    tensor * input_row = tensor_view(inputs);
+
+    for(int t = 0; t < length; t++){
+        for(int b = 0; b < batch; b++){
+            tensor_slice(row, segment, 0, t * batch + b, 1);
+            tensor_convert(row, tensor_slice(input_row, inputs, 0, b * rows + start + t, 1));
+        }
+    }
+
+    tensor_cleanup(row);
+    tensor_cleanup(input_row);
+
+    return segment;
+}
+
+/*
+Runs steps [start, start + length) through the history slots from slot on, h and c enter in slot.
+x_t never enters the loop: W_x * X of the whole segment is one GEMM before it and, when outputs is given,
+Wy * H one GEMM after it, so the serial path of a step is the W_h * h_t mat-vec the kernels add into
+the projected gates, and the cell update. Every operand is a view of the history or the segment buffers
+*/
+static void lstm_forward_segment(LSTM * self, tensor * inputs, int rows, int start, int length, int slot, tensor ** outputs){
+    lstm_weights * weights = self->weights;
+    int batch = self->batch_size;
+    int hidden_size = self->hidden_size;
+    int columns = length * batch;
+    int blocks = lstm_gate_blocks(weights);
+    int block_rows = 4 * hidden_size / blocks;
+
+    PROFILE_BEGIN(PROFILE_LSTM_CONCAT);
+    tensor * segment = lstm_segment_inputs(self, inputs, rows, start, length);
+    PROFILE_END(PROFILE_LSTM_CONCAT, 0, 2 * lstm_bytes(segment));
+
+    tensor * segment_t = tensor_transpose(tensor_view(segment), segment);
+    // the pre-activations stay in the history for lstm_backward
+    tensor * projected = lstm_columns(self->pre_activations, slot * batch, columns);
+    tensor * block = tensor_view(projected);
+    tensor * column = tensor_view(projected);
+
+    PROFILE_BEGIN(PROFILE_LSTM_INPUT_PROJECTION);
+    for(int g = 0; g < blocks; g++){
+        tensor_mat_mul(tensor_slice(block, projected, 0, g * block_rows, block_rows), weights->Wx[g], segment_t);
+    }
+    PROFILE_END(PROFILE_LSTM_INPUT_PROJECTION, 2.0 * tensor_shape(segment)[1] * 4 * hidden_size * columns, 
+        blocks * lstm_bytes(weights->Wx[0]) + lstm_bytes(segment) + lstm_bytes(projected)
+    );
+
+    for(int t = 0; t < length; t++){
+        int s = slot + t;
+
+        PROFILE_BEGIN(PROFILE_LSTM_GATES);
+        tensor_slice(column, projected, 1, t * batch, batch);
+
+        // the projected columns turn into the pre-activations in place
+        for(int g = 0; g < blocks; g++){
+            tensor_mat_mul_accumulate(tensor_slice(block, column, 0, g * block_rows, block_rows), weights->Wh[g], self->hidden_states[s]);
+        }
+
+        // the column is strided in the history, its activations are gathered into the contiguous gate scratch
+        tensor_gate_activations(self->cell.gates, column);
+        PROFILE_END(PROFILE_LSTM_GATES, lstm_gate_flops(weights->Wh[0], self->cell.gates, PROFILE_GATE_FLOPS), 
+            blocks * lstm_bytes(weights->Wh[0]) + lstm_bytes(self->hidden_states[s]) + 6 * lstm_bytes(self->cell.gates)
+        );
+
+        lstm_cell_update(&self->cell, self->cell_states[s], self->hidden_states[s + 1], self->cell_states[s + 1]);
+    }
+
+    if(outputs != NULL){
+        tensor * hidden = lstm_columns(self->segment_hidden, 0, columns);
+        tensor * output = lstm_columns(self->segment_outputs, 0, columns);
+
+        lstm_gather_steps(hidden, self->hidden_states + slot + 1, length, batch);
+
+        PROFILE_BEGIN(PROFILE_LSTM_PROJECTION);
+        tensor_mat_mul(output, weights->Wy, hidden);
+        PROFILE_END(PROFILE_LSTM_PROJECTION, 2.0 * hidden_size * self->output_size * columns, 
+            lstm_bytes(weights->Wy) + lstm_bytes(hidden) + lstm_bytes(output)
+        );
+
+        lstm_scatter_steps(outputs, output, length, batch);
+
+        tensor_cleanup(hidden);
+        tensor_cleanup(output);
+    }
+
+    tensor * temporaries[] = {segment, segment_t, projected, block, column};
+    for(size_t i = 0; i < ARRAY_LENGTH(temporaries); i++){
+        tensor_cleanup(temporaries[i]);
+    }
+}
+
+/*
+Runs the steps one segment at a time through the segment buffers, saving h and c at the start of every segment
+*/
+static void lstm_forward_checkpointed(LSTM * self, tensor * inputs, int rows){
+    int interval = self->checkpoint_interval;
+    int steps = self->sequence_length;
+
+    for(int start = 0; start < steps; start += interval){
+        int length = steps - start < interval ? steps - start : interval;
+
+        if(start > 0){
+            tensor_convert(self->hidden_states[0], self->hidden_states[interval]);
+            tensor_convert(self->cell_states[0], self->cell_states[interval]);
+        }
+
+        tensor_convert(self->checkpoint_hidden[start / interval], self->hidden_states[0]);
+        tensor_convert(self->checkpoint_cells[start / interval], self->cell_states[0]);
+
+        lstm_forward_segment(self, inputs, rows, start, length, 0, self->outputs + start);
+    }
+}
+
+tensor ** lstm_forward_batch(LSTM * self, tensor * inputs, int batch){
+    TENSOR_CHECK(self->flags & LSTM_INFERENCE, "LSTM in inference mode keeps no history, use lstm_infer");
+
+    int rows = lstm_batch_rows(inputs, batch);
+    TENSOR_CHECK(rows < self->sequence_length, "Sequences of %d rows are shorter than %d steps", rows, self->sequence_length);
+
+    lstm_set_batch_size(self, batch);
+    lstm_reset_state(self);
+
+    const backend_ops * previous = lstm_enter_backend(self->backend);
+
+    if(self->flags & LSTM_CHECKPOINT){
+        lstm_forward_checkpointed(self, inputs, rows);
+    }else{
+        lstm_forward_segment(self, inputs, rows, 0, self->sequence_length, 0, self->outputs);
+    }
+
+    backend_set_current(previous);
+
+    // referenced, not copied, for lstm_backward
+    tensor * view = tensor_view(inputs);
+    tensor_cleanup(self->inputs);
+    self->inputs = view;
+    self->inputs_batch = batch;
+    self->inputs_steps = self->sequence_length;
+    self->inputs_generation = ++self->generation;
+
     return self->outputs;
 }
 
+static void lstm_infer_(LSTM * self, tensor * inputs, int batch, tensor * outputs, lstm_output_callback callback, void * context){
+    int rows = lstm_batch_rows(inputs, batch);
+
+    lstm_set_batch_size(self, batch);
+    lstm_reset_state(self);
+
+    if(outputs != NULL){
+        int * output_shape = tensor_shape(outputs);
+        TENSOR_CHECK(output_shape[0] != rows * self->output_size || output_shape[1] != batch, 
+            "Output buffer should be [%d x %d], got [%d x %d]", rows * self->output_size, batch, output_shape[0], output_shape[1]
+        );
+    }
+
+    const backend_ops * previous = lstm_enter_backend(self->backend);
+
+    // the steps below overwrite the first history slot of lstm_forward_batch
+    self->generation++;
+
+    for(int i = 0; i < rows; i++){
+        // the view is re-pointed every step, nothing is allocated in the loop
+        tensor * output = self->outputs[0];
+        if(outputs != NULL){
+            output = tensor_slice(self->output_view, outputs, 0, i * self->output_size, self->output_size);
+        }
+
+        lstm_cell_step(self, inputs, rows, i, output);
+
+        if(callback != NULL){
+            callback(i, output, context);
+        }
+    }
+
+    backend_set_current(previous);
+}
+
+void lstm_infer(LSTM * self, tensor * inputs, int batch, tensor * outputs){
+    TENSOR_EXIST(outputs);
+    lstm_infer_(self, inputs, batch, outputs, NULL, NULL);
+}
+
+void lstm_infer_callback(LSTM * self, tensor * inputs, int batch, lstm_output_callback callback, void * context){
+    TENSOR_CHECK(callback == NULL, "Callback undefined");
+    lstm_infer_(self, inputs, batch, NULL, callback, context);
+}
+
+/*
+(Re)allocates the step input gradients for the current batch size of lstm
+*/
+static void lstm_gradients_resize(lstm_gradients * self, LSTM * lstm){
+    if(self->d_input != NULL){
+        if(self->batch_size == lstm->batch_size){
+            return;
+        }
+
+        tensor_array_cleanup(self->d_inputs, self->sequence_length);
+        tensor_cleanup(self->d_input);
+    }
+
+    int steps = lstm->sequence_length;
+    int batch = lstm->batch_size;
+    int input_shape[2] = {lstm->input_size - lstm->hidden_size, steps * batch};
+
+    self->batch_size = batch;
+    self->d_input = tensor_init_with_dtype(2, input_shape, lstm_state_dtype(lstm->flags));
+    self->d_inputs = create_tensor_array(steps);
+
+    for(int t = 0; t < steps; t++){
+        self->d_inputs[t] = tensor_slice(tensor_view(self->d_input), self->d_input, 1, t * batch, batch);
+    }
+}
+
+lstm_gradients * lstm_gradients_init(LSTM * lstm){
+    TENSOR_CHECK(lstm == NULL, "LSTM undefined");
+
+    lstm_gradients * self = (lstm_gradients *)SAFE_MALLOC(sizeof(lstm_gradients));
+
+    dtype type = lstm_state_dtype(lstm->flags);
+    int hidden_size = lstm->hidden_size;
+    int weight_shape[2] = {4 * hidden_size, lstm->input_size};
+    int output_shape[2] = {lstm->output_size, hidden_size};
+
+    self->sequence_length = lstm->sequence_length;
+    self->dW = tensor_init_with_dtype(2, weight_shape, type);
+    self->dWf = tensor_slice(tensor_view(self->dW), self->dW, 0, 0, hidden_size);
+    self->dWi = tensor_slice(tensor_view(self->dW), self->dW, 0, hidden_size, hidden_size);
+    self->dWc = tensor_slice(tensor_view(self->dW), self->dW, 0, 2 * hidden_size, hidden_size);
+    self->dWo = tensor_slice(tensor_view(self->dW), self->dW, 0, 3 * hidden_size, hidden_size);
+    self->dWy = tensor_init_with_dtype(2, output_shape, type);
+
+    self->d_input = NULL;
+    self->d_inputs = NULL;
+    lstm_gradients_resize(self, lstm);
+
+    return self;
+}
+
+/*
+The gate weights as one [4H x I] block, unfused gates are copied into a new one
+*/
+static tensor * lstm_fused_weights(lstm_weights * weights){
+    if(weights->W != NULL){
+        return tensor_view(weights->W);
+    }
+
+    int hidden_size = weights->hidden_size;
+    int shape[2] = {4 * hidden_size, weights->input_size};
+    tensor * W = tensor_init_with_dtype(2, shape, tensor_dtype(weights->Wf));
+    tensor * gates[4] = {weights->Wf, weights->Wi, weights->Wc, weights->Wo};
+    tensor * block = tensor_view(W);
+
+    for(int g = 0; g < 4; g++){
+        tensor_convert(tensor_slice(block, W, 0, g * hidden_size, hidden_size), gates[g]);
+    }
+
+    tensor_cleanup(block);
+
+    return W;
+}
+
+/*
+State of lstm_backward carried from one segment of steps to the one before it
+*/
+typedef struct lstm_backward_state{
+    // gate weights as one block and the transposed column blocks applied to h and x, Wy^T
+    tensor * W;
+    tensor * Wh_t;
+    tensor * Wx_t;
+    tensor * Wy_t;
+
+    // [hidden x batch] dL/dh and dL/dc flowing into the next segment to process, per step scratch
+    tensor * dh;
+    tensor * dc;
+    tensor * dh_step;
+    tensor * dg;
+    // contiguous copy of the pre-activations of the step and its four gate blocks
+    tensor * pre;
+    tensor * pre_gates[4];
+
+    // products of later segments are added to the gradients, NULL when there is a single segment
+    tensor * dW_part;
+    tensor * dWy_part;
+} lstm_backward_state;
+
+/*
+mat_mul into out, or into part and added to out
+*/
+static inline void lstm_mat_mul_accumulate(tensor * out, tensor * part, int accumulate, tensor * t1, tensor * t2){
+    if(accumulate){
+        tensor_plus_(out, tensor_mat_mul(part, t1, t2));
+    }else{
+        tensor_mat_mul(out, t1, t2);
+    }
+}
+
+/*
+Backpropagates through steps [start, start + length) whose activations sit in the history slots from slot on.
+The steps are laid side by side as length * batch columns, so the products that do not feed the recurrence
+run once per segment instead of once per step
+*/
+static void lstm_backward_segment(LSTM * self, tensor ** output_gradients, lstm_gradients * gradients, lstm_backward_state * state, 
+    int start, int length, int slot, int accumulate){
+    dtype type = lstm_state_dtype(self->flags);
+    int batch = self->batch_size;
+    int hidden_size = self->hidden_size;
+    int features = self->input_size - hidden_size;
+    int columns = length * batch;
+
+    int output_shape[2] = {self->output_size, columns};
+    int hidden_shape[2] = {hidden_size, columns};
+    int states_shape[2] = {hidden_size, columns + batch};
+    int gates_shape[2] = {4 * hidden_size, columns};
+
+    tensor * d_outputs = tensor_init_with_dtype(2, output_shape, type);
+    tensor * states = tensor_init_with_dtype(2, states_shape, type);
+    tensor * d_gates = tensor_init_with_dtype(2, gates_shape, type);
+    tensor * d_hidden = tensor_init_with_dtype(2, hidden_shape, type);
+
+    // h_start to h_{start + length}, the steps read the first length of them and write the last length
+    lstm_gather_steps(d_outputs, output_gradients + start, length, batch);
+    lstm_gather_steps(states, self->hidden_states + slot, length + 1, batch);
+
+    // dWy = dY * H^T and the projection part of dh = Wy^T * dY
+    tensor * hidden_t = lstm_transposed_columns(states, batch, columns);
+    lstm_mat_mul_accumulate(gradients->dWy, state->dWy_part, accumulate, d_outputs, hidden_t);
+    tensor_mat_mul(d_hidden, state->Wy_t, d_outputs);
+
+    tensor * column = tensor_view(d_hidden);
+    tensor * gates_column = tensor_view(d_gates);
+    tensor * pre_column = tensor_view(self->pre_activations);
+
+    for(int t = length - 1; t >= 0; t--){
+        tensor_plus(state->dh_step, state->dh, tensor_slice(column, d_hidden, 1, t * batch, batch));
+
+        int s = slot + t;
+        tensor_convert(state->pre, tensor_slice(pre_column, self->pre_activations, 1, s * batch, batch));
+        tensor_lstm_cell_backward(state->dg, state->dc, state->dh_step, state->pre_gates, self->cell_states[s], self->cell_states[s + 1]);
+
+        tensor_convert(tensor_slice(gates_column, d_gates, 1, t * batch, batch), state->dg);
+
+        // h_0 is the fixed zero state, nothing flows into it
+        if(start + t > 0){
+            tensor_mat_mul(state->dh, state->Wh_t, state->dg);
+        }
+    }
+
+    // dW = dG * [h; x]^T as its W_h and W_x column blocks and dx = W_x^T * dG over the whole segment,
+    // the step major input rows of the segment already are X^T
+    tensor * previous_t = lstm_transposed_columns(states, 0, columns);
+    tensor * segment = lstm_segment_inputs(self, self->inputs, lstm_batch_rows(self->inputs, batch), start, length);
+    tensor * dWh = lstm_columns(gradients->dW, 0, hidden_size);
+    tensor * dWx = lstm_columns(gradients->dW, hidden_size, features);
+    tensor * dWh_part = lstm_columns(state->dW_part, 0, hidden_size);
+    tensor * dWx_part = lstm_columns(state->dW_part, hidden_size, features);
+
+    lstm_mat_mul_accumulate(dWh, dWh_part, accumulate, d_gates, previous_t);
+    lstm_mat_mul_accumulate(dWx, dWx_part, accumulate, d_gates, segment);
+
+    tensor * d_input = lstm_columns(gradients->d_input, start * batch, columns);
+    tensor_mat_mul(d_input, state->Wx_t, d_gates);
+
+    tensor * temporaries[] = {d_outputs, states, d_gates, d_hidden, hidden_t, column, gates_column, pre_column, previous_t, segment, 
+        dWh, dWx, dWh_part, dWx_part, d_input
+    };
+    for(size_t i = 0; i < ARRAY_LENGTH(temporaries); i++){
+        tensor_cleanup(temporaries[i]);
+    }
+}
+
+/*
+Refills the segment buffers with steps [start, start + length) from the checkpoint at start, without the projection
+*/
+static void lstm_recompute_segment(LSTM * self, int start, int length){
+    int index = start / self->checkpoint_interval;
+    int rows = lstm_batch_rows(self->inputs, self->batch_size);
+
+    tensor_convert(self->hidden_states[0], self->checkpoint_hidden[index]);
+    tensor_convert(self->cell_states[0], self->checkpoint_cells[index]);
+
+    lstm_forward_segment(self, self->inputs, rows, start, length, 0, NULL);
+}
+
+void lstm_backward(LSTM * self, tensor ** output_gradients, lstm_gradients * gradients){
+    TENSOR_CHECK(self->flags & LSTM_INFERENCE, "LSTM in inference mode keeps no history to backpropagate through");
+    TENSOR_CHECK(self->flags & LSTM_INT8, "Quantized weights cannot be trained, backpropagate through the floating point model");
+    TENSOR_CHECK(output_gradients == NULL || gradients == NULL, "Output gradients and gradient buffers are required");
+    TENSOR_CHECK(gradients->sequence_length != self->sequence_length, 
+        "Gradients were created for %d steps, the model runs %d", gradients->sequence_length, self->sequence_length
+    );
+
+    TENSOR_CHECK(self->inputs == NULL, "Backward needs a lstm_forward_batch first");
+    TENSOR_CHECK(self->generation != self->inputs_generation || self->batch_size != self->inputs_batch || 
+        self->sequence_length != self->inputs_steps, 
+        "The history of the last lstm_forward_batch (batch %d, %d steps) was overwritten since, run it again before lstm_backward", 
+        self->inputs_batch, self->inputs_steps
+    );
+
+    int checkpointed = (self->flags & LSTM_CHECKPOINT) != 0;
+
+    lstm_gradients_resize(gradients, self);
+
+    dtype type = lstm_state_dtype(self->flags);
+    int steps = self->sequence_length;
+    int segment = lstm_history(self);
+    int hidden_size = self->hidden_size;
+
+    const backend_ops * previous = lstm_enter_backend(self->backend);
+
+    lstm_backward_state state;
+    int state_shape[2] = {hidden_size, self->batch_size};
+    int step_gates_shape[2] = {4 * hidden_size, self->batch_size};
+
+    state.W = lstm_fused_weights(self->weights);
+    state.Wh_t = lstm_transposed_columns(state.W, 0, hidden_size);
+    state.Wx_t = lstm_transposed_columns(state.W, hidden_size, self->input_size - hidden_size);
+    state.Wy_t = lstm_transposed_columns(self->weights->Wy, 0, hidden_size);
+    state.dh = tensor_fill(tensor_init_with_dtype(2, state_shape, type), 0);
+    state.dc = tensor_fill(tensor_init_with_dtype(2, state_shape, type), 0);
+    state.dh_step = tensor_init_with_dtype(2, state_shape, type);
+    state.dg = tensor_init_with_dtype(2, step_gates_shape, type);
+    state.pre = tensor_init_with_dtype(2, step_gates_shape, type);
+    for(int g = 0; g < 4; g++){
+        state.pre_gates[g] = tensor_slice(tensor_view(state.pre), state.pre, 0, g * hidden_size, hidden_size);
+    }
+    state.dW_part = segment < steps ? tensor_init_with_dtype(2, tensor_shape(gradients->dW), type) : NULL;
+    state.dWy_part = segment < steps ? tensor_init_with_dtype(2, tensor_shape(gradients->dWy), type) : NULL;
+
+    // segments run last to first, without checkpoints there is one covering every step
+    int last = ((steps - 1) / segment) * segment;
+    for(int start = last; start >= 0; start -= segment){
+        int length = steps - start < segment ? steps - start : segment;
+
+        // also the last segment, the buffers may hold another one after an earlier lstm_backward
+        if(checkpointed){
+            lstm_recompute_segment(self, start, length);
+        }
+
+        lstm_backward_segment(self, output_gradients, gradients, &state, start, length, checkpointed ? 0 : start, start != last);
+    }
+
+    backend_set_current(previous);
+
+    tensor * temporaries[] = {state.W, state.Wh_t, state.Wx_t, state.Wy_t, state.dh, state.dc, state.dh_step, state.dg, 
+        state.pre, state.pre_gates[0], state.pre_gates[1], state.pre_gates[2], state.pre_gates[3], state.dW_part, state.dWy_part
+    };
+    for(size_t i = 0; i < ARRAY_LENGTH(temporaries); i++){
+        tensor_cleanup(temporaries[i]);
+    }
+}
+
+void lstm_gradients_cleanup(lstm_gradients * self){
+    if(self == NULL){
+        return;
+    }
+
+    tensor_cleanup(self->dWf);
+    tensor_cleanup(self->dWi);
+    tensor_cleanup(self->dWc);
+    tensor_cleanup(self->dWo);
+    tensor_cleanup(self->dW);
+    tensor_cleanup(self->dWy);
+    tensor_array_cleanup(self->d_inputs, self->sequence_length);
+    tensor_cleanup(self->d_input);
 
+    SAFE_FREE(self);
+}
 
 void lstm_cleanup(LSTM * this){
     if(this == NULL){
         return;
     }
 
-    tensor_cleanup(this->Wf);
-    tensor_cleanup(this->Wi);
-    tensor_cleanup(this->Wo);
-    tensor_cleanup(this->Wy);
-    tensor_cleanup(this->Wc);
+    lstm_state_cleanup(this);
+    lstm_weights_release(this->weights);
+    tensor_cleanup(this->inputs);
 
-    tensor_array_cleanup(this->hidden_states, this->sequence_length + 1);
-    tensor_array_cleanup(this->cell_states, this->sequence_length + 1);
-
-    tensor_array_cleanup(this->concat_inputs, this->sequence_length);
-    tensor_array_cleanup(this->forget_gates, this->sequence_length);
-    tensor_array_cleanup(this->input_gates, this->sequence_length);
-    tensor_array_cleanup(this->candidate_gates, this->sequence_length);
-    tensor_array_cleanup(this->output_gates, this->sequence_length);
-    tensor_array_cleanup(this->outputs, this->sequence_length);
+    // releases the headers and payloads above in one go, the calls only dropped references
+    arena_cleanup(this->arena);
 
     SAFE_FREE(this);
+}
+
+lstm_session * lstm_session_init(LSTM * lstm, int batch_size){
+    TENSOR_CHECK(lstm == NULL, "LSTM undefined");
+
+    lstm_session * session = lstm_session_init_with_weights(lstm->weights, batch_size);
+    session->backend = lstm->backend;
+
+    return session;
+}
+
+lstm_session * lstm_session_init_with_weights(lstm_weights * weights, int batch_size){
+    TENSOR_CHECK(weights == NULL, "Weights undefined");
+    TENSOR_CHECK(batch_size < 1, "Batch size should at least be 1, got %d", batch_size);
+
+    lstm_session * session = (lstm_session *)SAFE_MALLOC(sizeof(lstm_session));
+    session->weights = lstm_weights_retain(weights);
+    session->backend = NULL;
+    session->batch_size = batch_size;
+
+    dtype type = lstm_state_dtype(weights->flags);
+    int hidden_size = weights->hidden_size;
+
+    // h lives in the upper rows of the concat, a step only copies its input below it
+    lstm_cell_init(&session->cell, weights->input_size, hidden_size, batch_size, type);
+    session->hidden_state = tensor_slice(tensor_view(session->cell.concat_input), session->cell.concat_input, 0, 0, hidden_size);
+    session->input = tensor_slice(tensor_view(session->cell.concat_input), session->cell.concat_input, 0, hidden_size, weights->input_size - hidden_size);
+
+    int state_shape[2] = {hidden_size, batch_size};
+    session->cell_state = tensor_init_with_dtype(2, state_shape, type);
+
+    lstm_session_reset(session);
+
+    return session;
+}
+
+void lstm_session_reset(lstm_session * self){
+    tensor_fill(self->hidden_state, 0);
+    tensor_fill(self->cell_state, 0);
+    self->steps = 0;
+}
+
+tensor * lstm_step(lstm_session * self, tensor * input, tensor * output){
+    TENSOR_EXIST(input);
+    TENSOR_CHECK((output == NULL) != (self->weights->Wy == NULL), 
+        "Step output should be given exactly when the weights have an output projection"
+    );
+
+    TENSOR_CHECK(tensor_shape(input)[0] != tensor_shape(self->input)[0] || tensor_shape(input)[1] != self->batch_size, 
+        "Step input should be [%d x %d], got [%d x %d]", tensor_shape(self->input)[0], self->batch_size, tensor_shape(input)[0], tensor_shape(input)[1]
+    );
+
+    // h and c are updated in place, the gates are computed from the concat before the cell overwrites h
+    PROFILE_BEGIN(PROFILE_LSTM_CONCAT);
+    tensor_convert(self->input, input);
+    PROFILE_END(PROFILE_LSTM_CONCAT, 0, lstm_bytes(input) + lstm_bytes(self->input));
+
+    const backend_ops * previous = lstm_enter_backend(self->backend);
+    lstm_cell_forward(self->weights, &self->cell, self->cell_state, self->hidden_state, self->cell_state, output);
+    backend_set_current(previous);
+
+    self->steps++;
+
+    return output;
+}
+
+lstm_snapshot * lstm_session_snapshot(lstm_session * self){
+    lstm_snapshot * snapshot = (lstm_snapshot *)SAFE_MALLOC(sizeof(lstm_snapshot));
+
+    snapshot->hidden_state = tensor_astype(self->hidden_state, tensor_dtype(self->hidden_state));
+    snapshot->cell_state = tensor_astype(self->cell_state, tensor_dtype(self->cell_state));
+    snapshot->steps = self->steps;
+
+    return snapshot;
+}
+
+void lstm_session_restore(lstm_session * self, lstm_snapshot * snapshot){
+    TENSOR_CHECK(snapshot == NULL, "Snapshot undefined");
+
+    // converts when the snapshot comes from a model with another state dtype
+    tensor_convert(self->hidden_state, snapshot->hidden_state);
+    tensor_convert(self->cell_state, snapshot->cell_state);
+    self->steps = snapshot->steps;
+}
+
+void lstm_snapshot_cleanup(lstm_snapshot * self){
+    if(self == NULL){
+        return;
+    }
+
+    tensor_cleanup(self->hidden_state);
+    tensor_cleanup(self->cell_state);
+    SAFE_FREE(self);
+}
+
+void lstm_session_cleanup(lstm_session * self){
+    if(self == NULL){
+        return;
+    }
+
+    tensor_cleanup(self->hidden_state);
+    tensor_cleanup(self->input);
+    tensor_cleanup(self->cell_state);
+
+    lstm_cell_cleanup(&self->cell);
+
+    lstm_weights_release(self->weights);
+
+    SAFE_FREE(self);
 }
\ No newline at end of file
@@ -0,0 +1,327 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "model.h"
+
+/*
+A read-only file mapping, every Data over it holds a reference and the last one unmaps it
+*/
+typedef struct model_mapping{
+    void * base;
+    size_t bytes;
+    struct ref refcount;
+} model_mapping;
+
+static uint32_t crc_table[256];
+
+__attribute__((constructor)) static void crc_init(void){
+    // reflected IEEE 802.3 polynomial, the CRC-32 of zlib and png
+    for(uint32_t i = 0; i < 256; i++){
+        uint32_t crc = i;
+        for(int bit = 0; bit < 8; bit++){
+            crc = (crc >> 1) ^ (0xedb88320u & -(crc & 1));
+        }
+        crc_table[i] = crc;
+    }
+}
+
+static uint32_t crc32(const void * ptr, size_t bytes){
+    const unsigned char * p = ptr;
+    uint32_t crc = 0xffffffffu;
+
+    for(size_t i = 0; i < bytes; i++){
+        crc = crc_table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc ^ 0xffffffffu;
+}
+
+static inline uint64_t model_align(uint64_t offset){
+    return (offset + LSTM_MODEL_ALIGNMENT - 1) & ~(uint64_t)(LSTM_MODEL_ALIGNMENT - 1);
+}
+
+/*
+Matrices of the weights in file order, the scales of an int8 matrix right after it
+*/
+static int model_blobs(lstm_weights * weights, tensor * blobs[LSTM_MODEL_MAX_BLOBS]){
+    tensor * matrices[5];
+    int matrix_count = 0;
+    int count = 0;
+
+    if(weights->flags & LSTM_FUSED_GATES){
+        matrices[matrix_count++] = weights->W;
+    }else{
+        matrices[matrix_count++] = weights->Wf;
+        matrices[matrix_count++] = weights->Wi;
+        matrices[matrix_count++] = weights->Wc;
+        matrices[matrix_count++] = weights->Wo;
+    }
+
+    if(weights->Wy != NULL){
+        matrices[matrix_count++] = weights->Wy;
+    }
+
+    for(int i = 0; i < matrix_count; i++){
+        blobs[count++] = matrices[i];
+        if(weights->flags & LSTM_INT8){
+            blobs[count++] = tensor_scale(matrices[i]);
+        }
+    }
+
+    return count;
+}
+
+static void model_write(FILE * file, const void * ptr, size_t bytes, const char * path){
+    if(fwrite(ptr, 1, bytes, file) != bytes){
+        PANIC("Could not write model file %s", path);
+    }
+}
+
+void lstm_weights_save(lstm_weights * weights, const char * path){
+    TENSOR_CHECK(weights == NULL, "Weights undefined");
+
+    // written next to path and renamed over it, processes still mapping the old file keep reading it
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.%d.tmp", path, (int)getpid());
+
+    FILE * file = fopen(temporary, "wb");
+    if(file == NULL){
+        PANIC("Could not create model file %s", temporary);
+    }
+
+    lstm_model_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LSTM_MODEL_MAGIC, sizeof(LSTM_MODEL_MAGIC));
+    header.version = LSTM_MODEL_VERSION;
+    header.header_bytes = sizeof(lstm_model_header);
+    header.input_size = weights->input_size;
+    header.hidden_size = weights->hidden_size;
+    header.output_size = weights->output_size;
+    header.flags = weights->flags;
+
+    tensor * blobs[LSTM_MODEL_MAX_BLOBS];
+    header.blob_count = model_blobs(weights, blobs);
+
+    uint64_t offset = model_align(sizeof(lstm_model_header));
+    uint64_t end = offset;
+    static const char zeros[LSTM_MODEL_ALIGNMENT] = {0};
+
+    model_write(file, &header, sizeof(header), temporary);
+    model_write(file, zeros, offset - sizeof(header), temporary);
+
+    for(uint32_t i = 0; i < header.blob_count; i++){
+        tensor * blob = tensor_contiguous(blobs[i]);
+        int rows = tensor_shape(blob)[0];
+        int cols = tensor_shape(blob)[1];
+        size_t bytes = (size_t)rows * cols * dtype_size(tensor_dtype(blob));
+
+        model_write(file, zeros, offset - end, temporary);
+        model_write(file, tensor_raw_data(blob), bytes, temporary);
+
+        header.blobs[i] = (lstm_model_blob){
+            .offset = offset,
+            .bytes = bytes,
+            .dtype = tensor_dtype(blob),
+            .rows = rows,
+            .cols = cols,
+            .checksum = crc32(tensor_raw_data(blob), bytes),
+        };
+
+        end = offset + bytes;
+        offset = model_align(end);
+        tensor_cleanup(blob);
+    }
+
+    header.file_bytes = end;
+    header.checksum = crc32(&header, offsetof(lstm_model_header, checksum));
+
+    rewind(file);
+    model_write(file, &header, sizeof(header), temporary);
+
+    if(fclose(file) != 0 || rename(temporary, path) != 0){
+        remove(temporary);
+        PANIC("Could not write model file %s", path);
+    }
+}
+
+void lstm_save(LSTM * lstm, const char * path){
+    TENSOR_CHECK(lstm == NULL, "LSTM undefined");
+
+    lstm_weights_save(lstm->weights, path);
+}
+
+static void model_mapping_free(const struct ref * ref){
+    model_mapping * mapping = container_of(ref, model_mapping, refcount);
+
+    munmap(mapping->base, mapping->bytes);
+    SAFE_FREE(mapping);
+}
+
+/*
+Maps path read-only, NULL with errno set when it cannot be opened or is too small to hold a header
+*/
+static model_mapping * model_map(const char * path){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+        return NULL;
+    }
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(lstm_model_header)){
+        close(fd);
+        return NULL;
+    }
+
+    // pages stay valid after the descriptor is closed
+    void * base = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(base == MAP_FAILED){
+        return NULL;
+    }
+
+    model_mapping * mapping = (model_mapping *)SAFE_MALLOC(sizeof(model_mapping));
+    mapping->base = base;
+    mapping->bytes = info.st_size;
+    mapping->refcount.free = model_mapping_free;
+    atomic_init(&mapping->refcount.count, 1);
+
+    return mapping;
+}
+
+/*
+NULL when the header describes blobs that fit the file, the problem otherwise
+*/
+static const char * model_header_error(const lstm_model_header * header, size_t file_bytes){
+    if(memcmp(header->magic, LSTM_MODEL_MAGIC, sizeof(LSTM_MODEL_MAGIC)) != 0){
+        return "not a model file";
+    }
+    if(header->version != LSTM_MODEL_VERSION || header->header_bytes != sizeof(lstm_model_header)){
+        return "unsupported version or byte order";
+    }
+    if(header->checksum != crc32(header, offsetof(lstm_model_header, checksum))){
+        return "header checksum mismatch";
+    }
+    if(header->file_bytes > file_bytes){
+        return "file truncated";
+    }
+
+    int matrices = (header->flags & LSTM_FUSED_GATES ? 1 : 4) + (header->output_size > 0 ? 1 : 0);
+    if(header->blob_count != (uint32_t)matrices * (header->flags & LSTM_INT8 ? 2 : 1)){
+        return "blob count does not match the flags";
+    }
+
+    for(uint32_t i = 0; i < header->blob_count; i++){
+        const lstm_model_blob * blob = &header->blobs[i];
+        uint64_t elements = (uint64_t)blob->rows * blob->cols;
+
+        if(blob->dtype > DTYPE_I8 || elements == 0 || elements > (uint64_t)__INT_MAX__){
+            return "invalid blob shape or dtype";
+        }
+        if(blob->bytes != elements * dtype_size(blob->dtype) || blob->offset % LSTM_MODEL_ALIGNMENT != 0 ||
+            blob->offset < sizeof(lstm_model_header) || blob->offset + blob->bytes > header->file_bytes){
+            return "blob outside the file or misaligned";
+        }
+
+        // an int8 matrix is followed by its fp32 scale per row
+        if(header->flags & LSTM_INT8 && i % 2 == 1 &&
+            (blob->dtype != DTYPE_F32 || blob->rows != header->blobs[i - 1].rows || blob->cols != 1)){
+            return "scale blob does not match its matrix";
+        }
+    }
+
+    return NULL;
+}
+
+/*
+A matrix over its blob in the mapping, nothing is copied
+*/
+static tensor * model_tensor(model_mapping * mapping, const lstm_model_blob * blob){
+    int shape[2] = {blob->rows, blob->cols};
+
+    Data * data = data_init_external(shape[0] * shape[1], blob->dtype, (char *)mapping->base + blob->offset, &mapping->refcount);
+    tensor * t = tensor_init_from_data(2, shape, data, 0);
+    data_dec(data);
+
+    return t;
+}
+
+lstm_weights * lstm_weights_load_mmap(const char * path){
+    model_mapping * mapping = model_map(path);
+    if(mapping == NULL){
+        PANIC("Could not map model file %s", path);
+    }
+
+    const lstm_model_header * header = mapping->base;
+    const char * error = model_header_error(header, mapping->bytes);
+    if(error != NULL){
+        PANIC("Invalid model file %s: %s", path, error);
+    }
+
+    int quantized = (header->flags & LSTM_INT8) != 0;
+    tensor * matrices[5];
+    int matrix_count = 0;
+
+    for(uint32_t i = 0; i < header->blob_count; i += quantized ? 2 : 1){
+        tensor * matrix = model_tensor(mapping, &header->blobs[i]);
+        if(quantized){
+            tensor_set_scale(matrix, model_tensor(mapping, &header->blobs[i + 1]));
+        }
+        matrices[matrix_count++] = matrix;
+    }
+
+    tensor * Wy = header->output_size > 0 ? matrices[matrix_count - 1] : NULL;
+    lstm_weights * weights = header->flags & LSTM_FUSED_GATES ?
+        lstm_weights_from_tensors(header->flags, matrices[0], NULL, Wy) :
+        lstm_weights_from_tensors(header->flags, NULL, matrices, Wy);
+
+    TENSOR_CHECK((uint32_t)weights->input_size != header->input_size || (uint32_t)weights->hidden_size != header->hidden_size ||
+        (uint32_t)weights->output_size != header->output_size, "Invalid model file %s: blob shapes do not match the sizes", path
+    );
+
+    // the tensors hold the mapping from here on
+    ref_dec(&mapping->refcount);
+
+    return weights;
+}
+
+LSTM * lstm_load_mmap(const char * path, int sequence_length, int flags){
+    lstm_weights * weights = lstm_weights_load_mmap(path);
+
+    LSTM * lstm = lstm_init_with_weights(weights, sequence_length, flags);
+    lstm_weights_release(weights);
+
+    return lstm;
+}
+
+int lstm_model_verify(const char * path){
+    model_mapping * mapping = model_map(path);
+    if(mapping == NULL){
+        fprintf(stderr, "%s: could not be mapped\n", path);
+        return 0;
+    }
+
+    const lstm_model_header * header = mapping->base;
+    const char * error = model_header_error(header, mapping->bytes);
+    int valid = error == NULL;
+
+    if(!valid){
+        fprintf(stderr, "%s: %s\n", path, error);
+    }
+
+    for(uint32_t i = 0; valid && i < header->blob_count; i++){
+        const lstm_model_blob * blob = &header->blobs[i];
+
+        if(crc32((const char *)mapping->base + blob->offset, blob->bytes) != blob->checksum){
+            fprintf(stderr, "%s: checksum mismatch in blob %u\n", path, i);
+            valid = 0;
+        }
+    }
+
+    ref_dec(&mapping->refcount);
+
+    return valid;
+}
\ No newline at end of file
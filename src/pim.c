@@ -0,0 +1,425 @@
+#include <pthread.h>
+
+#include "pim.h"
+#include "gemm.h"
+#include "thread_pool.h"
+
+pim_config pim_config_default(int banks){
+    return (pim_config){
+        .banks = banks,
+        .mram_bytes = PIM_MRAM_BYTES,
+        .wram_bytes = PIM_WRAM_BYTES,
+        .frequency_mhz = PIM_FREQUENCY_MHZ,
+        .cycles_per_mac = PIM_CYCLES_PER_MAC,
+        .cycles_per_activation = PIM_CYCLES_PER_ACTIVATION,
+        .mram_gbps = PIM_MRAM_GBPS,
+        .host_to_bank_gbps = PIM_HOST_TO_BANK_GBPS,
+        .bank_to_host_gbps = PIM_BANK_TO_HOST_GBPS,
+    };
+}
+
+/*
+Same as the activations of the lstm, bf16 weights carry state in f32
+*/
+static inline dtype pim_state_dtype(lstm_weights * weights){
+    return (weights->flags & (LSTM_FLOAT32 | LSTM_BFLOAT16)) ? DTYPE_F32 : DTYPE_F64;
+}
+
+static void pim_bank_load(pim_lstm * self, pim_bank * bank){
+    lstm_weights * weights = self->weights;
+    tensor * gates[4] = {weights->Wf, weights->Wi, weights->Wc, weights->Wo};
+
+    int shape[2] = {4 * bank->units, weights->input_size};
+    bank->weights = tensor_init_with_dtype(2, shape, tensor_dtype(weights->Wf));
+
+    tensor * src = tensor_view(weights->Wf);
+    tensor * dest = tensor_view(bank->weights);
+
+    for(int g = 0; g < 4; g++){
+        tensor_slice(src, gates[g], 0, bank->first_unit, bank->units);
+        tensor_slice(dest, bank->weights, 0, g * bank->units, bank->units);
+        tensor_convert(dest, src);
+    }
+
+    tensor_cleanup(src);
+    tensor_cleanup(dest);
+
+    size_t weight_bytes = (size_t)4 * bank->units * weights->input_size * dtype_size(tensor_dtype(bank->weights));
+    self->report.weight_bytes += weight_bytes;
+
+    // c lives next to the weights between calls
+    bank->mram_used = weight_bytes + (size_t)bank->units * dtype_size(pim_state_dtype(weights));
+    TENSOR_CHECK(bank->mram_used > self->config.mram_bytes, 
+        "Bank of %d units needs %zu bytes of MRAM, %zu available, use more banks", bank->units, bank->mram_used, self->config.mram_bytes
+    );
+}
+
+static void pim_bank_state_cleanup(pim_bank * bank){
+    tensor_cleanup(bank->forget_gate);
+    tensor_cleanup(bank->input_gate);
+    tensor_cleanup(bank->candidate_gate);
+    tensor_cleanup(bank->output_gate);
+    tensor_cleanup(bank->gates);
+    tensor_cleanup(bank->cell_state);
+    tensor_cleanup(bank->hidden_state);
+}
+
+static void pim_bank_state_init(pim_lstm * self, pim_bank * bank, int batch_size){
+    lstm_weights * weights = self->weights;
+    dtype type = pim_state_dtype(weights);
+    int units = bank->units;
+
+    int gates_shape[2] = {4 * units, batch_size};
+    bank->gates = tensor_init_with_dtype(2, gates_shape, type);
+    bank->forget_gate = tensor_slice(tensor_view(bank->gates), bank->gates, 0, 0, units);
+    bank->input_gate = tensor_slice(tensor_view(bank->gates), bank->gates, 0, units, units);
+    bank->candidate_gate = tensor_slice(tensor_view(bank->gates), bank->gates, 0, 2 * units, units);
+    bank->output_gate = tensor_slice(tensor_view(bank->gates), bank->gates, 0, 3 * units, units);
+
+    int state_shape[2] = {units, batch_size};
+    bank->cell_state = tensor_init_with_dtype(2, state_shape, type);
+    bank->hidden_state = tensor_init_with_dtype(2, state_shape, type);
+
+    // broadcast [h; x], gates, c and h, plus one weight row streamed in from MRAM
+    bank->wram_used = ((size_t)weights->input_size + 6 * units) * batch_size * dtype_size(type)
+        + (size_t)weights->input_size * dtype_size(tensor_dtype(bank->weights));
+    TENSOR_CHECK(bank->wram_used > self->config.wram_bytes, 
+        "Bank of %d units needs %zu bytes of WRAM at batch %d, %zu available, use more banks or a smaller batch", 
+        units, bank->wram_used, batch_size, self->config.wram_bytes
+    );
+}
+
+static void pim_state_cleanup(pim_lstm * self){
+    for(int k = 0; k < self->config.banks; k++){
+        pim_bank_state_cleanup(&self->banks[k]);
+    }
+
+    tensor_cleanup(self->hidden_state);
+    tensor_cleanup(self->input);
+    tensor_cleanup(self->gather_view);
+    tensor_cleanup(self->output_view);
+    tensor_cleanup(self->concat);
+}
+
+static void pim_state_init(pim_lstm * self, int batch_size){
+    lstm_weights * weights = self->weights;
+    self->batch_size = batch_size;
+
+    for(int k = 0; k < self->config.banks; k++){
+        pim_bank_state_init(self, &self->banks[k], batch_size);
+    }
+
+    int concat_shape[2] = {weights->input_size, batch_size};
+    self->concat = tensor_init_with_dtype(2, concat_shape, pim_state_dtype(weights));
+    self->hidden_state = tensor_slice(tensor_view(self->concat), self->concat, 0, 0, weights->hidden_size);
+    self->input = tensor_slice(tensor_view(self->concat), self->concat, 0, weights->hidden_size, weights->input_size - weights->hidden_size);
+    self->gather_view = tensor_view(self->concat);
+    self->output_view = tensor_view(self->concat);
+}
+
+pim_lstm * pim_lstm_init(lstm_weights * weights, pim_config config){
+    TENSOR_CHECK(weights == NULL, "Weights undefined");
+    TENSOR_CHECK(weights->Wy == NULL, "The emulator needs weights with an output projection");
+    TENSOR_CHECK(weights->flags & LSTM_INT8, "Banks are loaded from floating point weights");
+    TENSOR_CHECK(config.banks < 1 || config.banks > weights->hidden_size, 
+        "Bank count should be in [1, %d], got %d", weights->hidden_size, config.banks
+    );
+
+    pim_lstm * pim = (pim_lstm *)SAFE_MALLOC(sizeof(pim_lstm));
+    pim->config = config;
+    pim->weights = lstm_weights_retain(weights);
+    pim->report = (pim_report){.banks = config.banks};
+
+    pim->banks = (pim_bank *)SAFE_MALLOC(sizeof(pim_bank) * config.banks);
+    pim->bank_seconds = (double *)SAFE_MALLOC(sizeof(double) * config.banks);
+
+    // the first hidden_size % banks banks take one unit more
+    int base = weights->hidden_size / config.banks;
+    int extra = weights->hidden_size % config.banks;
+
+    for(int k = 0, first = 0; k < config.banks; k++){
+        pim_bank * bank = &pim->banks[k];
+        bank->first_unit = first;
+        bank->units = base + (k < extra);
+        bank->seconds = 0;
+        bank->macs = 0;
+        first += bank->units;
+
+        pim_bank_load(pim, bank);
+    }
+
+    pim_state_init(pim, 1);
+
+    return pim;
+}
+
+/*
+Modelled time of one step on a bank. Tasklets overlap the MRAM stream of the weight rows with the
+arithmetic, so the slower of the two bounds the step
+*/
+static double pim_bank_step_seconds(pim_lstm * self, pim_bank * bank, int batch){
+    pim_config * config = &self->config;
+    int input_size = self->weights->input_size;
+
+    double macs = 4.0 * bank->units * input_size * batch;
+    // the four gates and tanh(c)
+    double activations = 5.0 * bank->units * batch;
+
+    double compute = (macs * config->cycles_per_mac + activations * config->cycles_per_activation) / (config->frequency_mhz * 1e6);
+    double stream = 4.0 * bank->units * input_size * dtype_size(tensor_dtype(bank->weights)) / (config->mram_gbps * 1e9);
+
+    return compute > stream ? compute : stream;
+}
+
+static void pim_banks_step(int begin, int end, void * context){
+    pim_lstm * self = (pim_lstm *)context;
+
+    for(int k = begin; k < end; k++){
+        pim_bank * bank = &self->banks[k];
+
+        tensor_mat_mul_gates(bank->gates, bank->weights, self->concat);
+
+        tensor_mul(bank->hidden_state, bank->input_gate, bank->candidate_gate);
+        tensor_mul(bank->cell_state, bank->forget_gate, bank->cell_state);
+        tensor_plus_(bank->cell_state, bank->hidden_state);
+
+        tensor_tanh(bank->hidden_state, bank->cell_state);
+        tensor_mul_(bank->hidden_state, bank->output_gate);
+    }
+}
+
+static void pim_step(pim_lstm * self){
+    pim_config * config = &self->config;
+    lstm_weights * weights = self->weights;
+    int batch = self->batch_size;
+    size_t state_size = dtype_size(pim_state_dtype(weights));
+
+    // the same [h; x] goes to every bank
+    size_t broadcast = (size_t)weights->input_size * batch * state_size * config->banks;
+    self->report.broadcast_bytes += broadcast;
+
+    thread_pool_parallel_for(config->banks, 1, pim_banks_step, self);
+
+    double slowest = 0;
+    for(int k = 0; k < config->banks; k++){
+        pim_bank * bank = &self->banks[k];
+
+        tensor_slice(self->gather_view, self->hidden_state, 0, bank->first_unit, bank->units);
+        tensor_convert(self->gather_view, bank->hidden_state);
+
+        double seconds = pim_bank_step_seconds(self, bank, batch);
+        bank->seconds += seconds;
+        bank->macs += (long)4 * bank->units * weights->input_size * batch;
+        slowest = seconds > slowest ? seconds : slowest;
+    }
+
+    size_t gather = (size_t)weights->hidden_size * batch * state_size;
+    self->report.gather_bytes += gather;
+
+    double transfer = broadcast / (config->host_to_bank_gbps * 1e9) + gather / (config->bank_to_host_gbps * 1e9);
+    self->report.transfer_seconds += transfer;
+    self->report.total_seconds += transfer + slowest;
+    self->report.steps++;
+}
+
+void pim_lstm_infer(pim_lstm * self, tensor * inputs, int batch, tensor * outputs){
+    TENSOR_EXIST(inputs);
+    TENSOR_EXIST(outputs);
+    TENSOR_CHECK(batch < 1, "Batch size should at least be 1, got %d", batch);
+
+    lstm_weights * weights = self->weights;
+    int output_size = weights->output_size;
+
+    int * input_shape = tensor_shape(inputs);
+    TENSOR_CHECK(input_shape[0] % batch != 0, "Input rows %d not divisible by batch %d", input_shape[0], batch);
+    int rows = input_shape[0] / batch;
+
+    int * output_shape = tensor_shape(outputs);
+    TENSOR_CHECK(output_shape[0] != rows * output_size || output_shape[1] != batch, 
+        "Output buffer should be [%d x %d], got [%d x %d]", rows * output_size, batch, output_shape[0], output_shape[1]
+    );
+
+    if(self->batch_size != batch){
+        pim_state_cleanup(self);
+        pim_state_init(self, batch);
+    }
+
+    tensor_fill(self->hidden_state, 0);
+    for(int k = 0; k < self->config.banks; k++){
+        tensor_fill(self->banks[k].cell_state, 0);
+    }
+
+    for(int t = 0; t < rows; t++){
+        tensor_select_batch(self->input, inputs, t, rows);
+        pim_step(self);
+
+        // the projection stays on the host, it would need h broadcast a second time
+        tensor_slice(self->output_view, outputs, 0, t * output_size, output_size);
+        tensor_mat_mul(self->output_view, weights->Wy, self->hidden_state);
+    }
+}
+
+pim_report pim_lstm_report(pim_lstm * self){
+    pim_report report = self->report;
+    int banks = self->config.banks;
+
+    double sum = 0;
+    report.max_bank_seconds = 0;
+    for(int k = 0; k < banks; k++){
+        self->bank_seconds[k] = self->banks[k].seconds;
+        sum += self->banks[k].seconds;
+        report.max_bank_seconds = self->banks[k].seconds > report.max_bank_seconds ? self->banks[k].seconds : report.max_bank_seconds;
+    }
+
+    report.bank_seconds = self->bank_seconds;
+    report.mean_bank_seconds = sum / banks;
+    report.imbalance = sum > 0 ? report.max_bank_seconds / report.mean_bank_seconds : 1;
+
+    return report;
+}
+
+void pim_report_printf(pim_report * report){
+    printf("PIM(banks=%d, steps=%ld)\n", report->banks, report->steps);
+    printf("  weights   %zu bytes\n", report->weight_bytes);
+    printf("  broadcast %zu bytes\n", report->broadcast_bytes);
+    printf("  gather    %zu bytes\n", report->gather_bytes);
+    printf("  transfer  %.3f ms\n", report->transfer_seconds * 1e3);
+    printf("  bank      %.3f ms max, %.3f ms mean, imbalance %.3f\n", 
+        report->max_bank_seconds * 1e3, report->mean_bank_seconds * 1e3, report->imbalance
+    );
+    printf("  total     %.3f ms, %.3f us per step\n", 
+        report->total_seconds * 1e3, report->steps > 0 ? report->total_seconds * 1e6 / report->steps : 0.0
+    );
+}
+
+void pim_lstm_cleanup(pim_lstm * self){
+    if(self == NULL){
+        return;
+    }
+
+    pim_state_cleanup(self);
+
+    for(int k = 0; k < self->config.banks; k++){
+        tensor_cleanup(self->banks[k].weights);
+    }
+
+    lstm_weights_release(self->weights);
+
+    SAFE_FREE(self->banks);
+    SAFE_FREE(self->bank_seconds);
+    SAFE_FREE(self);
+}
+
+/*
+Operands of a product split across the banks of the pim backend
+*/
+typedef struct pim_job{
+    int banks;
+    int m;
+    int n;
+    int k;
+    const double * a;
+    int rsa;
+    int csa;
+    const double * b;
+    int rsb;
+    int csb;
+    double * c;
+    int ldc;
+    int accumulate;
+} pim_job;
+
+static pthread_mutex_t backend_lock = PTHREAD_MUTEX_INITIALIZER;
+static pim_report backend_report = {0};
+
+static int backend_banks = PIM_BACKEND_BANKS;
+
+/*
+Reads LSTM_PIM_BANKS once before main, products only read the result
+*/
+__attribute__((constructor)) static void pim_backend_init(void){
+    const char * value = getenv("LSTM_PIM_BANKS");
+    int banks = value != NULL ? atoi(value) : 0;
+
+    backend_banks = banks > 0 ? banks : PIM_BACKEND_BANKS;
+}
+
+/*
+Rows of bank k when m rows are split over banks, the first m % banks banks take one more
+*/
+static inline int pim_bank_rows(int m, int banks, int k, int * first){
+    int base = m / banks;
+    int extra = m % banks;
+
+    *first = k * base + (k < extra ? k : extra);
+    return base + (k < extra);
+}
+
+static void pim_job_banks(int begin, int end, void * context){
+    pim_job * job = (pim_job *)context;
+
+    for(int k = begin; k < end; k++){
+        int first;
+        int rows = pim_bank_rows(job->m, job->banks, k, &first);
+
+        gemm_strided_serial(rows, job->n, job->k, job->a + (long)first * job->rsa, job->rsa, job->csa, 
+            job->b, job->rsb, job->csb, job->c + (long)first * job->ldc, job->ldc, job->accumulate
+        );
+    }
+}
+
+void pim_mat_mul(int m, int n, int k, const double * a, int rsa, int csa, const double * b, int rsb, int csb, double * c, int ldc, int accumulate){
+    int banks = backend_banks < m ? backend_banks : m;
+
+    pim_job job = {
+        .banks = banks, .m = m, .n = n, .k = k, 
+        .a = a, .rsa = rsa, .csa = csa, 
+        .b = b, .rsb = rsb, .csb = csb, 
+        .c = c, .ldc = ldc, .accumulate = accumulate,
+    };
+    // an accumulated product adds the gathered rows on the host, the modelled transfers stay the same
+    thread_pool_parallel_for(banks, 1, pim_job_banks, &job);
+
+    pim_config config = pim_config_default(banks);
+
+    size_t broadcast = (size_t)k * n * sizeof(double) * banks;
+    size_t gather = (size_t)m * n * sizeof(double);
+    double transfer = broadcast / (config.host_to_bank_gbps * 1e9) + gather / (config.bank_to_host_gbps * 1e9);
+
+    // the first bank has the most rows
+    int first;
+    double rows = pim_bank_rows(m, banks, 0, &first);
+    double compute = rows * n * k * config.cycles_per_mac / (config.frequency_mhz * 1e6);
+    double stream = rows * k * sizeof(double) / (config.mram_gbps * 1e9);
+    double slowest = compute > stream ? compute : stream;
+
+    double mean_rows = (double)m / banks;
+    compute = mean_rows * n * k * config.cycles_per_mac / (config.frequency_mhz * 1e6);
+    stream = mean_rows * k * sizeof(double) / (config.mram_gbps * 1e9);
+    double mean = compute > stream ? compute : stream;
+
+    pthread_mutex_lock(&backend_lock);
+
+    backend_report.banks = banks > backend_report.banks ? banks : backend_report.banks;
+    backend_report.steps++;
+    backend_report.weight_bytes += (size_t)m * k * sizeof(double);
+    backend_report.broadcast_bytes += broadcast;
+    backend_report.gather_bytes += gather;
+    backend_report.transfer_seconds += transfer;
+    backend_report.max_bank_seconds += slowest;
+    backend_report.mean_bank_seconds += mean;
+    backend_report.total_seconds += transfer + slowest;
+
+    pthread_mutex_unlock(&backend_lock);
+}
+
+pim_report pim_backend_report(void){
+    pthread_mutex_lock(&backend_lock);
+    pim_report report = backend_report;
+    pthread_mutex_unlock(&backend_lock);
+
+    report.bank_seconds = NULL;
+    report.imbalance = report.mean_bank_seconds > 0 ? report.max_bank_seconds / report.mean_bank_seconds : 1;
+
+    return report;
+}
\ No newline at end of file
@@ -0,0 +1,237 @@
+#include "profile.h"
+
+#ifdef LSTM_PROFILE
+
+#include <pthread.h>
+#include <string.h>
+
+#include "utils.h"
+
+/*
+Events a thread keeps for the trace, later ones are only counted
+*/
+#define PROFILE_TRACE_CAPACITY (1 << 20)
+
+typedef struct profile_counter{
+    long long calls;
+    long long ns;
+    unsigned long long cycles;
+    double flops;
+    double bytes;
+} profile_counter;
+
+typedef struct profile_trace_event{
+    profile_event event;
+    long long start_ns;
+    long long ns;
+} profile_trace_event;
+
+/*
+Heap allocated so the counters outlive their thread, the dump at exit reads every table ever registered
+*/
+typedef struct profile_thread{
+    int id;
+    profile_counter counters[PROFILE_EVENT_COUNT];
+
+    profile_trace_event * trace;
+    int trace_length;
+    int trace_capacity;
+    long long trace_dropped;
+
+    struct profile_thread * next;
+} profile_thread;
+
+static const char * const profile_names[PROFILE_EVENT_COUNT] = {
+    [PROFILE_TENSOR_MAT_MUL] = "tensor_mat_mul",
+    [PROFILE_TENSOR_MAT_MUL_GATES] = "tensor_mat_mul_gates",
+    [PROFILE_TENSOR_PLUS] = "tensor_plus",
+    [PROFILE_TENSOR_MUL] = "tensor_mul",
+    [PROFILE_TENSOR_SIGMOID] = "tensor_sigmoid",
+    [PROFILE_TENSOR_TANH] = "tensor_tanh",
+    [PROFILE_TENSOR_GATE_ACTIVATIONS] = "tensor_gate_activations",
+    [PROFILE_TENSOR_CONCAT] = "tensor_concat",
+    [PROFILE_TENSOR_SELECT_BATCH] = "tensor_select_batch",
+    [PROFILE_TENSOR_CONVERT] = "tensor_convert",
+    [PROFILE_TENSOR_LSTM_CELL_BACKWARD] = "tensor_lstm_cell_backward",
+    [PROFILE_LSTM_CONCAT] = "lstm.concat",
+    [PROFILE_LSTM_INPUT_PROJECTION] = "lstm.input_projection",
+    [PROFILE_LSTM_GATES] = "lstm.gates",
+    [PROFILE_LSTM_FORGET_GATE] = "lstm.forget_gate",
+    [PROFILE_LSTM_INPUT_GATE] = "lstm.input_gate",
+    [PROFILE_LSTM_CANDIDATE_GATE] = "lstm.candidate_gate",
+    [PROFILE_LSTM_OUTPUT_GATE] = "lstm.output_gate",
+    [PROFILE_LSTM_CELL_UPDATE] = "lstm.cell_update",
+    [PROFILE_LSTM_PROJECTION] = "lstm.projection",
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_once_t once;
+    profile_thread * threads;
+    int thread_count;
+    // NULL unless LSTM_PROFILE_TRACE is set
+    const char * trace_path;
+    long long start_ns;
+} profile = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .once = PTHREAD_ONCE_INIT,
+};
+
+static _Thread_local profile_thread * current_thread = NULL;
+
+static void profile_setup(void){
+    profile.trace_path = getenv("LSTM_PROFILE_TRACE");
+    profile.start_ns = profile_now_ns();
+    atexit(profile_dump);
+}
+
+static profile_thread * profile_thread_get(void){
+    if(current_thread != NULL){
+        return current_thread;
+    }
+
+    pthread_once(&profile.once, profile_setup);
+
+    profile_thread * thread = SAFE_MALLOC(sizeof(profile_thread));
+    memset(thread, 0, sizeof(profile_thread));
+
+    pthread_mutex_lock(&profile.lock);
+    thread->id = profile.thread_count++;
+    thread->next = profile.threads;
+    profile.threads = thread;
+    pthread_mutex_unlock(&profile.lock);
+
+    current_thread = thread;
+    return thread;
+}
+
+static void profile_trace_push(profile_thread * thread, const profile_scope * scope, long long ns){
+    if(thread->trace_length == thread->trace_capacity){
+        if(thread->trace_capacity == PROFILE_TRACE_CAPACITY){
+            thread->trace_dropped++;
+            return;
+        }
+
+        int capacity = thread->trace_capacity == 0 ? 1024 : thread->trace_capacity * 2;
+        profile_trace_event * trace = realloc(thread->trace, capacity * sizeof(profile_trace_event));
+        if(trace == NULL){
+            PANIC("Memory could not be allocated");
+        }
+
+        thread->trace = trace;
+        thread->trace_capacity = capacity;
+    }
+
+    thread->trace[thread->trace_length++] = (profile_trace_event){scope->event, scope->start_ns, ns};
+}
+
+void profile_end(const profile_scope * scope, double flops, double bytes){
+    long long ns = profile_now_ns() - scope->start_ns;
+    unsigned long long cycles = PROFILE_CYCLES() - scope->start_cycles;
+
+    profile_thread * thread = profile_thread_get();
+    profile_counter * counter = &thread->counters[scope->event];
+
+    counter->calls++;
+    counter->ns += ns;
+    counter->cycles += cycles;
+    counter->flops += flops;
+    counter->bytes += bytes;
+
+    if(profile.trace_path != NULL){
+        profile_trace_push(thread, scope, ns);
+    }
+}
+
+static void profile_write_trace(FILE * file){
+    const char * separator = "";
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    for(profile_thread * thread = profile.threads; thread != NULL; thread = thread->next){
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+            separator, thread->id, thread->id
+        );
+        separator = ",\n";
+
+        for(int i = 0; i < thread->trace_length; i++){
+            profile_trace_event * event = &thread->trace[i];
+
+            // microseconds since the first profiled event
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                profile_names[event->event], thread->id, (event->start_ns - profile.start_ns) / 1e3, event->ns / 1e3
+            );
+        }
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+}
+
+void profile_dump(void){
+    pthread_mutex_lock(&profile.lock);
+
+    if(profile.threads == NULL){
+        pthread_mutex_unlock(&profile.lock);
+        return;
+    }
+
+    profile_counter total[PROFILE_EVENT_COUNT] = {0};
+    long long dropped = 0;
+
+    for(profile_thread * thread = profile.threads; thread != NULL; thread = thread->next){
+        for(int e = 0; e < PROFILE_EVENT_COUNT; e++){
+            total[e].calls += thread->counters[e].calls;
+            total[e].ns += thread->counters[e].ns;
+            total[e].cycles += thread->counters[e].cycles;
+            total[e].flops += thread->counters[e].flops;
+            total[e].bytes += thread->counters[e].bytes;
+        }
+        dropped += thread->trace_dropped;
+    }
+
+    fprintf(stderr, "\nprofile, %d thread(s), inclusive times\n", profile.thread_count);
+    fprintf(stderr, "%-24s %10s %12s %14s %10s %9s %9s\n", "event", "calls", "total ms", "cycles", "ns/call", "GFLOP/s", "GB/s");
+
+    for(int e = 0; e < PROFILE_EVENT_COUNT; e++){
+        profile_counter * counter = &total[e];
+        if(counter->calls == 0){
+            continue;
+        }
+
+        double seconds = counter->ns / 1e9;
+        fprintf(stderr, "%-24s %10lld %12.3f %14llu %10.0f %9.2f %9.2f\n",
+            profile_names[e], counter->calls, counter->ns / 1e6, counter->cycles, (double)counter->ns / counter->calls,
+            seconds > 0 ? counter->flops / seconds / 1e9 : 0, seconds > 0 ? counter->bytes / seconds / 1e9 : 0
+        );
+    }
+
+    if(profile.trace_path != NULL){
+        FILE * file = fopen(profile.trace_path, "w");
+        if(file == NULL){
+            fprintf(stderr, "profile: could not open %s, trace not written\n", profile.trace_path);
+        }else{
+            profile_write_trace(file);
+            fclose(file);
+            fprintf(stderr, "profile: trace written to %s", profile.trace_path);
+            if(dropped > 0){
+                fprintf(stderr, ", %lld events past %d per thread dropped", dropped, PROFILE_TRACE_CAPACITY);
+            }
+            fprintf(stderr, "\n");
+        }
+    }
+
+    pthread_mutex_unlock(&profile.lock);
+}
+
+void profile_reset(void){
+    pthread_mutex_lock(&profile.lock);
+
+    for(profile_thread * thread = profile.threads; thread != NULL; thread = thread->next){
+        memset(thread->counters, 0, sizeof(thread->counters));
+        thread->trace_length = 0;
+        thread->trace_dropped = 0;
+    }
+    profile.start_ns = profile_now_ns();
+
+    pthread_mutex_unlock(&profile.lock);
+}
+
+#endif // LSTM_PROFILE
\ No newline at end of file
@@ -0,0 +1,185 @@
+#include "quant.h"
+#include "simd.h"
+#include "utils.h"
+#include "gemm.h"
+#include "thread_pool.h"
+
+#define QUANT_LANES 32
+
+static inline int8_t quantize_value(double value, float inverse_scale){
+    double scaled = value * inverse_scale;
+    long rounded = (long)(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+
+    if(rounded > 127){
+        return 127;
+    }
+    if(rounded < -127){
+        return -127;
+    }
+    return (int8_t)rounded;
+}
+
+/*
+Quantizes length elements read with the given stride, returns the scale
+*/
+static float quantize_strided(const void * src, dtype type, size_t offset, size_t stride, int length, int8_t * q){
+    double max_abs = 0.0;
+    for(int i = 0; i < length; i++){
+        double value = dtype_get(src, type, offset + i * stride);
+        double magnitude = value < 0 ? -value : value;
+        if(magnitude > max_abs){
+            max_abs = magnitude;
+        }
+    }
+
+    float scale = (float)(max_abs / 127.0);
+    float inverse_scale = scale > 0 ? 1.0f / scale : 0.0f;
+
+    for(int i = 0; i < length; i++){
+        q[i] = quantize_value(dtype_get(src, type, offset + i * stride), inverse_scale);
+    }
+
+    return scale;
+}
+
+void quantize_rows(const void * src, dtype src_type, int rows, int cols, int8_t * q, float * scales){
+    for(int i = 0; i < rows; i++){
+        scales[i] = quantize_strided(src, src_type, (size_t)i * cols, 1, cols, q + (size_t)i * cols);
+    }
+}
+
+/*
+Dot products of four weight rows with one quantized column, QUANT_LANES independent int32 partial sums per row
+*/
+SIMD_TARGET_CLONES static void dot4_i8(int k, const int8_t * a, int lda, const int8_t * x, int32_t out[4]){
+    const int8_t * a0 = a;
+    const int8_t * a1 = a0 + lda;
+    const int8_t * a2 = a1 + lda;
+    const int8_t * a3 = a2 + lda;
+
+    int32_t acc[4][QUANT_LANES] = {{0}};
+    int p = 0;
+    for(; p + QUANT_LANES <= k; p += QUANT_LANES){
+        for(int l = 0; l < QUANT_LANES; l++){
+            int32_t x_p = x[p + l];
+            acc[0][l] += a0[p + l] * x_p;
+            acc[1][l] += a1[p + l] * x_p;
+            acc[2][l] += a2[p + l] * x_p;
+            acc[3][l] += a3[p + l] * x_p;
+        }
+    }
+
+    for(int r = 0; r < 4; r++){
+        const int8_t * a_row = a0 + r * lda;
+        int32_t output = 0;
+        for(int l = 0; l < QUANT_LANES; l++){
+            output += acc[r][l];
+        }
+        for(int q = p; q < k; q++){
+            output += a_row[q] * x[q];
+        }
+        out[r] = output;
+    }
+}
+
+SIMD_TARGET_CLONES static int32_t dot_i8(int k, const int8_t * a, const int8_t * x){
+    int32_t output = 0;
+    for(int p = 0; p < k; p++){
+        output += a[p] * x[p];
+    }
+    return output;
+}
+
+/*
+Activations quantized once per product, shared by the row blocks
+*/
+typedef struct quant_job{
+    int n;
+    int k;
+    const int8_t * a;
+    int lda;
+    const float * a_scale;
+    const int8_t * b_q;
+    const float * b_scale;
+    void * c;
+    dtype c_type;
+    int ldc;
+    int gate_rows;
+    quant_epilogue epilogue;
+} quant_job;
+
+/*
+Passes a dequantized sum through the epilogue into element (row, col) of c
+*/
+static inline void quant_store(quant_job * job, int row, int col, double value){
+    size_t index = (size_t)row * job->ldc + col;
+
+    if(job->epilogue == QUANT_EPILOGUE_LSTM_GATES){
+        value = row / job->gate_rows == 2 ? tanh(value) : sigmoid(value);
+    }else if(job->epilogue == QUANT_EPILOGUE_ACCUMULATE){
+        value += dtype_get(job->c, job->c_type, index);
+    }
+
+    dtype_set(job->c, job->c_type, index, value);
+}
+
+/*
+Output rows [begin, end), the epilogue sees absolute row numbers so gate blocks survive the split
+*/
+static void quant_rows(int begin, int end, void * context){
+    quant_job * job = (quant_job *)context;
+
+    int n = job->n;
+    int k = job->k;
+    int lda = job->lda;
+    int i = begin;
+
+    // four weight rows stay in L1 while every column streams past them
+    for(; i + 4 <= end; i += 4){
+        for(int j = 0; j < n; j++){
+            int32_t acc[4];
+            dot4_i8(k, job->a + (size_t)i * lda, lda, job->b_q + (size_t)j * k, acc);
+
+            for(int r = 0; r < 4; r++){
+                double value = (double)acc[r] * job->a_scale[i + r] * job->b_scale[j];
+                quant_store(job, i + r, j, value);
+            }
+        }
+    }
+
+    for(; i < end; i++){
+        for(int j = 0; j < n; j++){
+            double value = (double)dot_i8(k, job->a + (size_t)i * lda, job->b_q + (size_t)j * k) * job->a_scale[i] * job->b_scale[j];
+            quant_store(job, i, j, value);
+        }
+    }
+}
+
+void quant_gemm(int m, int n, int k, const int8_t * a, int lda, const float * a_scale, 
+    const void * b, dtype b_type, int ldb, void * c, dtype c_type, int ldc, quant_epilogue epilogue){
+
+    if(c_type != DTYPE_F64 && c_type != DTYPE_F32){
+        PANIC("Quantized output should be f64 or f32, got %s\n", dtype_name(c_type));
+    }
+
+    // columns of b transposed into contiguous int8 rows
+    int8_t * b_q = (int8_t *)gemm_scratch(GEMM_SCRATCH_QUANT, sizeof(int8_t) * n * k);
+    float * b_scale = (float *)gemm_scratch(GEMM_SCRATCH_QUANT_SCALES, sizeof(float) * n);
+
+    for(int j = 0; j < n; j++){
+        b_scale[j] = quantize_strided(b, b_type, j, ldb, k, b_q + (size_t)j * k);
+    }
+
+    quant_job job = {
+        .n = n, .k = k, .a = a, .lda = lda, .a_scale = a_scale, .b_q = b_q, .b_scale = b_scale, 
+        .c = c, .c_type = c_type, .ldc = ldc, .gate_rows = m / 4 > 0 ? m / 4 : 1, .epilogue = epilogue,
+    };
+
+    // the activations are quantized once above, the row blocks share them
+    if((long)m * n * k < GEMM_PARALLEL_FLOPS || m < 8){
+        quant_rows(0, m, &job);
+    }else{
+        int threads = thread_pool_threads();
+        thread_pool_parallel_for(m, (((m + threads - 1) / threads + 3) / 4) * 4, quant_rows, &job);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,425 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "reader.h"
+
+typedef struct reader_chunk{
+    // [steps * batch x features] rows, a view into the mapping with LSTM_READER_MMAP
+    tensor * rows;
+    int steps;
+    // set by the prefetch thread once rows is filled, cleared by the step loop when it moves on
+    int full;
+    // the file ended inside this chunk
+    int last;
+
+    // mapped bytes of the chunk, dropped from memory before the chunk is refilled
+    size_t map_offset;
+    size_t map_bytes;
+} reader_chunk;
+
+struct lstm_reader{
+    lstm_reader_config config;
+    size_t row_bytes;
+
+    // LSTM_READER_BINARY and LSTM_READER_CSV
+    FILE * file;
+    char * line;
+    size_t line_capacity;
+    long line_number;
+
+    // LSTM_READER_MMAP
+    char * base;
+    size_t bytes;
+    size_t position;
+    size_t page_size;
+
+    // the step loop reads chunks[current], the prefetch thread fills the other one
+    reader_chunk chunks[2];
+    int current;
+    int step;
+    int waiting;
+    long steps;
+    tensor * view;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t filled;
+    pthread_cond_t emptied;
+    int stop;
+};
+
+lstm_reader_config lstm_reader_config_default(int features){
+    return (lstm_reader_config){
+        .format = LSTM_READER_BINARY,
+        .features = features,
+        .batch_size = 1,
+        .chunk_steps = LSTM_READER_CHUNK_STEPS,
+        .type = DTYPE_F64,
+    };
+}
+
+static int reader_fill_binary(lstm_reader * self, reader_chunk * chunk){
+    int batch = self->config.batch_size;
+    size_t step_bytes = self->row_bytes * batch;
+    // bytes rather than rows, fread would drop a partial trailing row without a trace
+    size_t bytes = fread(tensor_raw_data(chunk->rows), 1, (size_t)self->config.chunk_steps * step_bytes, self->file);
+
+    TENSOR_CHECK(ferror(self->file), "Failed to read the input file");
+    TENSOR_CHECK(feof(self->file) && bytes % step_bytes != 0, 
+        "Input file ends inside a timestep, %zu bytes left for a timestep of %zu bytes", bytes % step_bytes, step_bytes
+    );
+
+    return bytes / step_bytes;
+}
+
+static int reader_fill_csv(lstm_reader * self, reader_chunk * chunk){
+    int features = self->config.features;
+    int batch = self->config.batch_size;
+    int capacity = self->config.chunk_steps * batch;
+    void * out = tensor_raw_data(chunk->rows);
+    int rows = 0;
+
+    while(rows < capacity && getline(&self->line, &self->line_capacity, self->file) >= 0){
+        self->line_number++;
+
+        char * p = self->line;
+        while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'){
+            p++;
+        }
+
+        if(*p == '\0'){
+            continue;
+        }
+
+        for(int f = 0; f < features; f++){
+            char * end;
+            double value = strtod(p, &end);
+            TENSOR_CHECK(end == p, "CSV line %ld: expected %d values, got %d", self->line_number, features, f);
+
+            dtype_set(out, self->config.type, (size_t)rows * features + f, value);
+
+            p = end;
+            while(*p == ' ' || *p == '\t'){
+                p++;
+            }
+            if(*p == ',' && f + 1 < features){
+                p++;
+            }
+        }
+
+        while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'){
+            p++;
+        }
+        TENSOR_CHECK(*p != '\0', "CSV line %ld: expected %d values, got more", self->line_number, features);
+
+        rows++;
+    }
+
+    TENSOR_CHECK(ferror(self->file), "Failed to read the input file");
+    TENSOR_CHECK(rows % batch != 0, "Input file ends inside a timestep, %d rows left for a batch of %d", rows % batch, batch);
+
+    return rows / batch;
+}
+
+/*
+Page aligned part of [offset, offset + bytes) in the mapping
+*/
+static inline void reader_madvise(lstm_reader * self, size_t offset, size_t bytes, int advice, int outward){
+    size_t mask = self->page_size - 1;
+    size_t begin = outward ? offset & ~mask : (offset + mask) & ~mask;
+    size_t end = outward ? (offset + bytes + mask) & ~mask : (offset + bytes) & ~mask;
+
+    if(end > begin){
+        madvise(self->base + begin, end - begin, advice);
+    }
+}
+
+static int reader_fill_mmap(lstm_reader * self, reader_chunk * chunk){
+    // the consumed pages stay in the page cache, they only leave the resident set of this process
+    if(chunk->map_bytes > 0){
+        reader_madvise(self, chunk->map_offset, chunk->map_bytes, MADV_DONTNEED, 0);
+    }
+
+    int batch = self->config.batch_size;
+    size_t step_bytes = self->row_bytes * batch;
+    size_t remaining = self->bytes - self->position;
+    size_t available = remaining / step_bytes;
+    int steps = available < (size_t)self->config.chunk_steps ? (int)available : self->config.chunk_steps;
+
+    // the last chunk, the file must end on a timestep like the stream formats
+    TENSOR_CHECK(available < (size_t)self->config.chunk_steps && remaining % step_bytes != 0, 
+        "Input file ends inside a timestep, %zu bytes left for a timestep of %zu bytes", remaining % step_bytes, step_bytes
+    );
+
+    chunk->map_offset = self->position;
+    chunk->map_bytes = steps * step_bytes;
+    self->position += chunk->map_bytes;
+
+    if(steps == 0){
+        return 0;
+    }
+
+    int shape[2] = {steps * batch, self->config.features};
+    Data * data = data_init_external(shape[0] * shape[1], self->config.type, self->base + chunk->map_offset, NULL);
+
+    tensor_cleanup(chunk->rows);
+    chunk->rows = tensor_init_from_data(2, shape, data, 0);
+    data_dec(data);
+
+    // fault the chunk in here, the step loop then only hits resident pages
+    reader_madvise(self, chunk->map_offset, chunk->map_bytes, MADV_WILLNEED, 1);
+
+    volatile const char * bytes = self->base + chunk->map_offset;
+    char sum = 0;
+    for(size_t offset = 0; offset < chunk->map_bytes; offset += self->page_size){
+        sum ^= bytes[offset];
+    }
+    (void)sum;
+
+    return steps;
+}
+
+static void * reader_main(void * arg){
+    lstm_reader * self = (lstm_reader *)arg;
+
+    for(int next = 0;; next ^= 1){
+        reader_chunk * chunk = &self->chunks[next];
+
+        pthread_mutex_lock(&self->lock);
+        while(chunk->full && !self->stop){
+            pthread_cond_wait(&self->emptied, &self->lock);
+        }
+        int stop = self->stop;
+        pthread_mutex_unlock(&self->lock);
+
+        if(stop){
+            break;
+        }
+
+        int steps;
+        switch(self->config.format){
+            case LSTM_READER_MMAP:
+                steps = reader_fill_mmap(self, chunk);
+                break;
+            case LSTM_READER_CSV:
+                steps = reader_fill_csv(self, chunk);
+                break;
+            default:
+                steps = reader_fill_binary(self, chunk);
+        }
+
+        int last = steps < self->config.chunk_steps;
+
+        pthread_mutex_lock(&self->lock);
+        chunk->steps = steps;
+        chunk->last = last;
+        chunk->full = 1;
+        pthread_cond_signal(&self->filled);
+        pthread_mutex_unlock(&self->lock);
+
+        if(last){
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void reader_open_mmap(lstm_reader * self, const char * path){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+        PANIC("Could not open input file %s", path);
+    }
+
+    struct stat info;
+    if(fstat(fd, &info) != 0){
+        close(fd);
+        PANIC("Could not stat input file %s", path);
+    }
+
+    self->bytes = info.st_size;
+    self->base = NULL;
+
+    if(self->bytes > 0){
+        void * base = mmap(NULL, self->bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(base == MAP_FAILED){
+            close(fd);
+            PANIC("Could not map input file %s", path);
+        }
+
+        self->base = base;
+        madvise(self->base, self->bytes, MADV_SEQUENTIAL);
+    }
+
+    close(fd);
+}
+
+lstm_reader * lstm_reader_open(const char * path, lstm_reader_config config){
+    if(config.chunk_steps == 0){
+        config.chunk_steps = LSTM_READER_CHUNK_STEPS;
+    }
+
+    TENSOR_CHECK(config.features < 1 || config.batch_size < 1 || config.chunk_steps < 1,
+        "Reader needs positive features, batch size and chunk steps, got %d, %d and %d", config.features, config.batch_size, config.chunk_steps
+    );
+    TENSOR_CHECK(config.type != DTYPE_F32 && config.type != DTYPE_F64, "Reader elements should be f32 or f64, got %s", dtype_name(config.type));
+    TENSOR_CHECK((long)config.chunk_steps * config.batch_size * config.features > INT_MAX,
+        "Chunk of %d steps too large, lower chunk_steps", config.chunk_steps
+    );
+
+    lstm_reader * self = (lstm_reader *)SAFE_MALLOC(sizeof(lstm_reader));
+    memset(self, 0, sizeof(lstm_reader));
+
+    self->config = config;
+    self->row_bytes = config.features * dtype_size(config.type);
+    self->page_size = sysconf(_SC_PAGESIZE);
+
+    if(config.format == LSTM_READER_MMAP){
+        reader_open_mmap(self, path);
+    }else{
+        self->file = fopen(path, config.format == LSTM_READER_CSV ? "r" : "rb");
+        if(self->file == NULL){
+            PANIC("Could not open input file %s", path);
+        }
+
+        int shape[2] = {config.chunk_steps * config.batch_size, config.features};
+        self->chunks[0].rows = tensor_init_with_dtype(2, shape, config.type);
+        self->chunks[1].rows = tensor_init_with_dtype(2, shape, config.type);
+    }
+
+    self->waiting = 1;
+
+    pthread_mutex_init(&self->lock, NULL);
+    pthread_cond_init(&self->filled, NULL);
+    pthread_cond_init(&self->emptied, NULL);
+
+    if(pthread_create(&self->thread, NULL, reader_main, self) != 0){
+        PANIC("Failed to start the reader thread\n");
+    }
+
+    return self;
+}
+
+tensor * lstm_reader_next(lstm_reader * self){
+    reader_chunk * chunk = &self->chunks[self->current];
+
+    if(!self->waiting && self->step == chunk->steps){
+        if(chunk->last){
+            return NULL;
+        }
+
+        // hand the chunk back for the prefetch thread to refill and move on to the other one
+        pthread_mutex_lock(&self->lock);
+        chunk->full = 0;
+        pthread_cond_signal(&self->emptied);
+        pthread_mutex_unlock(&self->lock);
+
+        self->current ^= 1;
+        self->step = 0;
+        self->waiting = 1;
+        chunk = &self->chunks[self->current];
+    }
+
+    if(self->waiting){
+        pthread_mutex_lock(&self->lock);
+        while(!chunk->full){
+            pthread_cond_wait(&self->filled, &self->lock);
+        }
+        pthread_mutex_unlock(&self->lock);
+
+        self->waiting = 0;
+
+        if(chunk->steps == 0){
+            return NULL;
+        }
+    }
+
+    if(self->view == NULL){
+        self->view = tensor_view(chunk->rows);
+    }
+
+    int batch = self->config.batch_size;
+    if(batch == 1){
+        // the row itself as a column
+        tensor_select(self->view, chunk->rows, self->step);
+    }else{
+        // the batch rows of the timestep, transposed into columns
+        tensor_slice(self->view, chunk->rows, 0, self->step * batch, batch);
+        tensor_transpose(self->view, self->view);
+    }
+
+    self->step++;
+    self->steps++;
+
+    return self->view;
+}
+
+long lstm_reader_steps(lstm_reader * self){
+    return self->steps;
+}
+
+long lstm_reader_run(lstm_reader * self, lstm_session * session, lstm_output_callback callback, void * context){
+    TENSOR_CHECK(session->batch_size != self->config.batch_size,
+        "Session batch size %d does not match the reader batch size %d", session->batch_size, self->config.batch_size
+    );
+
+    lstm_weights * weights = session->weights;
+    tensor * output = NULL;
+
+    if(weights->Wy != NULL){
+        int shape[2] = {weights->output_size, session->batch_size};
+        output = tensor_init_with_dtype(2, shape, tensor_dtype(session->hidden_state));
+    }
+
+    long steps = 0;
+    for(tensor * input = lstm_reader_next(self); input != NULL; input = lstm_reader_next(self)){
+        lstm_step(session, input, output);
+
+        if(callback != NULL){
+            callback(steps, output != NULL ? output : session->hidden_state, context);
+        }
+        steps++;
+    }
+
+    tensor_cleanup(output);
+
+    return steps;
+}
+
+void lstm_reader_close(lstm_reader * self){
+    if(self == NULL){
+        return;
+    }
+
+    pthread_mutex_lock(&self->lock);
+    self->stop = 1;
+    pthread_cond_broadcast(&self->emptied);
+    pthread_mutex_unlock(&self->lock);
+
+    pthread_join(self->thread, NULL);
+
+    tensor_cleanup(self->view);
+    tensor_cleanup(self->chunks[0].rows);
+    tensor_cleanup(self->chunks[1].rows);
+
+    if(self->file != NULL){
+        fclose(self->file);
+    }
+    if(self->base != NULL){
+        munmap(self->base, self->bytes);
+    }
+
+    SAFE_FREE(self->line);
+
+    pthread_mutex_destroy(&self->lock);
+    pthread_cond_destroy(&self->filled);
+    pthread_cond_destroy(&self->emptied);
+
+    SAFE_FREE(self);
+}
\ No newline at end of file
@@ -0,0 +1,358 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "scheduler.h"
+
+#define DEQUE_INITIAL_CAPACITY 16
+
+struct lstm_job{
+    lstm_scheduler * scheduler;
+    tensor * inputs;
+    tensor * outputs;
+    lstm_job_callback callback;
+    void * context;
+    atomic_int done;
+};
+
+/*
+Ring buffer of jobs, the owner works at the bottom and thieves take from the top
+*/
+typedef struct job_deque{
+    pthread_mutex_t lock;
+    lstm_job ** jobs;
+    int capacity;
+    long top;
+    long bottom;
+} job_deque;
+
+typedef struct worker{
+    lstm_scheduler * scheduler;
+    pthread_t thread;
+    int index;
+    job_deque deque;
+    // per worker activations over the shared weights
+    lstm_session * session;
+    // [features x 1] and [output_size x 1] columns owned by the worker
+    tensor * step_input;
+    tensor * step_output;
+    unsigned int seed;
+} worker;
+
+struct lstm_scheduler{
+    LSTM * lstm;
+    worker * workers;
+    int worker_count;
+
+    // jobs sitting in any deque and jobs not finished yet
+    atomic_int queued;
+    atomic_int unfinished;
+    atomic_int next_worker;
+
+    pthread_mutex_t lock;
+    // signalled when jobs are queued and when the scheduler stops
+    pthread_cond_t work;
+    // signalled when jobs finish
+    pthread_cond_t finished;
+    int stop;
+};
+
+static void deque_init(job_deque * self){
+    pthread_mutex_init(&self->lock, NULL);
+    self->capacity = DEQUE_INITIAL_CAPACITY;
+    self->jobs = (lstm_job **)SAFE_MALLOC(sizeof(lstm_job *) * self->capacity);
+    self->top = 0;
+    self->bottom = 0;
+}
+
+static void deque_cleanup(job_deque * self){
+    pthread_mutex_destroy(&self->lock);
+    SAFE_FREE(self->jobs);
+}
+
+static void deque_push(job_deque * self, lstm_job * job){
+    pthread_mutex_lock(&self->lock);
+
+    if(self->bottom - self->top == self->capacity){
+        lstm_job ** jobs = (lstm_job **)SAFE_MALLOC(sizeof(lstm_job *) * self->capacity * 2);
+        for(long i = self->top; i < self->bottom; i++){
+            jobs[i % (self->capacity * 2)] = self->jobs[i % self->capacity];
+        }
+
+        SAFE_FREE(self->jobs);
+        self->jobs = jobs;
+        self->capacity *= 2;
+    }
+
+    self->jobs[self->bottom % self->capacity] = job;
+    self->bottom++;
+
+    pthread_mutex_unlock(&self->lock);
+}
+
+static lstm_job * deque_pop(job_deque * self){
+    lstm_job * job = NULL;
+
+    pthread_mutex_lock(&self->lock);
+    if(self->bottom > self->top){
+        self->bottom--;
+        job = self->jobs[self->bottom % self->capacity];
+    }
+    pthread_mutex_unlock(&self->lock);
+
+    return job;
+}
+
+static lstm_job * deque_steal(job_deque * self){
+    lstm_job * job = NULL;
+
+    // a busy victim is skipped rather than waited for
+    if(pthread_mutex_trylock(&self->lock) != 0){
+        return NULL;
+    }
+
+    if(self->bottom > self->top){
+        job = self->jobs[self->top % self->capacity];
+        self->top++;
+    }
+    pthread_mutex_unlock(&self->lock);
+
+    return job;
+}
+
+/*
+Own deque first, then one sweep over the others starting at a random victim
+*/
+static lstm_job * worker_find_job(worker * self){
+    lstm_scheduler * scheduler = self->scheduler;
+
+    lstm_job * job = deque_pop(&self->deque);
+
+    if(job == NULL && scheduler->worker_count > 1){
+        int start = rand_r(&self->seed) % scheduler->worker_count;
+        for(int i = 0; i < scheduler->worker_count && job == NULL; i++){
+            int victim = (start + i) % scheduler->worker_count;
+            if(victim != self->index){
+                job = deque_steal(&scheduler->workers[victim].deque);
+            }
+        }
+    }
+
+    if(job != NULL){
+        atomic_fetch_sub(&scheduler->queued, 1);
+    }
+
+    return job;
+}
+
+static void worker_run_job(worker * self, lstm_job * job){
+    lstm_session * session = self->session;
+    int rows = tensor_shape(job->inputs)[0];
+
+    int output_size = tensor_shape(job->outputs)[1];
+    dtype type = tensor_dtype(job->outputs);
+    char * outputs = tensor_raw_data(job->outputs);
+
+    lstm_session_reset(session);
+
+    // rows are gathered into the columns of the worker, so any input dtype or layout steps the same way
+    for(int t = 0; t < rows; t++){
+        tensor_select_batch(self->step_input, job->inputs, t, 1);
+        lstm_step(session, self->step_input, self->step_output);
+        dtype_convert(tensor_raw_data(self->step_output), type, outputs + (size_t)t * output_size * dtype_size(type), type, output_size);
+    }
+
+    lstm_scheduler * scheduler = self->scheduler;
+    lstm_job_callback callback = job->callback;
+    void * context = job->context;
+
+    // done before the callback runs, so the callback may free the job and nothing below touches it
+    pthread_mutex_lock(&scheduler->lock);
+    atomic_store(&job->done, 1);
+    pthread_cond_broadcast(&scheduler->finished);
+    pthread_mutex_unlock(&scheduler->lock);
+
+    if(callback != NULL){
+        callback(job, job->outputs, context);
+    }
+
+    // counted after the callback, lstm_scheduler_wait_all also waits for the callbacks
+    pthread_mutex_lock(&scheduler->lock);
+    atomic_fetch_sub(&scheduler->unfinished, 1);
+    pthread_cond_broadcast(&scheduler->finished);
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+static void * worker_main(void * argument){
+    worker * self = (worker *)argument;
+    lstm_scheduler * scheduler = self->scheduler;
+
+    // created on the worker so the activations are first touched by the core that uses them
+    self->session = lstm_session_init(scheduler->lstm, 1);
+    LSTM * lstm = scheduler->lstm;
+    dtype type = tensor_dtype(self->session->cell_state);
+
+    int input_shape[2] = {lstm->input_size - lstm->hidden_size, 1};
+    int output_shape[2] = {lstm->output_size, 1};
+    self->step_input = tensor_init_with_dtype(2, input_shape, type);
+    self->step_output = tensor_init_with_dtype(2, output_shape, type);
+
+    for(;;){
+        lstm_job * job = worker_find_job(self);
+
+        if(job != NULL){
+            worker_run_job(self, job);
+            continue;
+        }
+
+        pthread_mutex_lock(&scheduler->lock);
+        while(atomic_load(&scheduler->queued) == 0 && !scheduler->stop){
+            pthread_cond_wait(&scheduler->work, &scheduler->lock);
+        }
+
+        int stop = scheduler->stop && atomic_load(&scheduler->queued) == 0;
+        pthread_mutex_unlock(&scheduler->lock);
+
+        if(stop){
+            break;
+        }
+    }
+
+    tensor_cleanup(self->step_input);
+    tensor_cleanup(self->step_output);
+    lstm_session_cleanup(self->session);
+
+    return NULL;
+}
+
+lstm_scheduler * lstm_scheduler_init(LSTM * lstm, int workers){
+    TENSOR_CHECK(lstm == NULL, "LSTM undefined");
+
+    if(workers <= 0){
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int)cpus : 1;
+    }
+
+    lstm_scheduler * scheduler = (lstm_scheduler *)SAFE_MALLOC(sizeof(lstm_scheduler));
+    scheduler->lstm = lstm;
+    scheduler->worker_count = workers;
+    scheduler->stop = 0;
+    atomic_init(&scheduler->queued, 0);
+    atomic_init(&scheduler->unfinished, 0);
+    atomic_init(&scheduler->next_worker, 0);
+
+    pthread_mutex_init(&scheduler->lock, NULL);
+    pthread_cond_init(&scheduler->work, NULL);
+    pthread_cond_init(&scheduler->finished, NULL);
+
+    scheduler->workers = (worker *)SAFE_MALLOC(sizeof(worker) * workers);
+    for(int i = 0; i < workers; i++){
+        worker * w = &scheduler->workers[i];
+        w->scheduler = scheduler;
+        w->index = i;
+        w->seed = (unsigned int)i * 2654435761u + 1;
+        deque_init(&w->deque);
+    }
+
+    for(int i = 0; i < workers; i++){
+        if(pthread_create(&scheduler->workers[i].thread, NULL, worker_main, &scheduler->workers[i]) != 0){
+            PANIC("Failed to start scheduler worker %d\n", i);
+        }
+    }
+
+    return scheduler;
+}
+
+lstm_job * lstm_scheduler_submit(lstm_scheduler * scheduler, tensor * inputs, lstm_job_callback callback, void * context){
+    TENSOR_EXIST(inputs);
+
+    LSTM * lstm = scheduler->lstm;
+    int * input_shape = tensor_shape(inputs);
+    TENSOR_CHECK(input_shape[1] != lstm->input_size - lstm->hidden_size, 
+        "Job inputs should have %d features, got %d", lstm->input_size - lstm->hidden_size, input_shape[1]
+    );
+
+    lstm_job * job = (lstm_job *)SAFE_MALLOC(sizeof(lstm_job));
+    job->scheduler = scheduler;
+    job->inputs = tensor_view(inputs);
+    job->callback = callback;
+    job->context = context;
+    atomic_init(&job->done, 0);
+
+    int output_shape[2] = {input_shape[0], lstm->output_size};
+    // same dtype as the session activations
+    job->outputs = tensor_init_with_dtype(2, output_shape, tensor_dtype(lstm->cell_states[0]));
+
+    atomic_fetch_add(&scheduler->unfinished, 1);
+    // counted before the push, a worker taking the job right away must not drive queued below zero
+    atomic_fetch_add(&scheduler->queued, 1);
+
+    int target = atomic_fetch_add(&scheduler->next_worker, 1) % scheduler->worker_count;
+    deque_push(&scheduler->workers[target].deque, job);
+
+    pthread_mutex_lock(&scheduler->lock);
+    pthread_cond_signal(&scheduler->work);
+    pthread_mutex_unlock(&scheduler->lock);
+
+    return job;
+}
+
+tensor * lstm_job_wait(lstm_job * job){
+    lstm_scheduler * scheduler = job->scheduler;
+
+    pthread_mutex_lock(&scheduler->lock);
+    while(!atomic_load(&job->done)){
+        pthread_cond_wait(&scheduler->finished, &scheduler->lock);
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+
+    return job->outputs;
+}
+
+int lstm_job_done(lstm_job * job){
+    return atomic_load(&job->done);
+}
+
+void lstm_job_cleanup(lstm_job * job){
+    if(job == NULL){
+        return;
+    }
+
+    lstm_job_wait(job);
+
+    tensor_cleanup(job->inputs);
+    tensor_cleanup(job->outputs);
+    SAFE_FREE(job);
+}
+
+void lstm_scheduler_wait_all(lstm_scheduler * scheduler){
+    pthread_mutex_lock(&scheduler->lock);
+    while(atomic_load(&scheduler->unfinished) > 0){
+        pthread_cond_wait(&scheduler->finished, &scheduler->lock);
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+void lstm_scheduler_cleanup(lstm_scheduler * scheduler){
+    if(scheduler == NULL){
+        return;
+    }
+
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->stop = 1;
+    pthread_cond_broadcast(&scheduler->work);
+    pthread_mutex_unlock(&scheduler->lock);
+
+    for(int i = 0; i < scheduler->worker_count; i++){
+        pthread_join(scheduler->workers[i].thread, NULL);
+        deque_cleanup(&scheduler->workers[i].deque);
+    }
+
+    pthread_mutex_destroy(&scheduler->lock);
+    pthread_cond_destroy(&scheduler->work);
+    pthread_cond_destroy(&scheduler->finished);
+
+    SAFE_FREE(scheduler->workers);
+    SAFE_FREE(scheduler);
+}
\ No newline at end of file
@@ -0,0 +1,436 @@
+#include <string.h>
+
+#include "simd.h"
+#include "utils.h"
+
+#if SIMD_X86
+#include <immintrin.h>
+#endif
+
+/*
+All kernels evaluate the same rational EXP approximation as utils.h. With p = (x + 3)^2 + 3 and
+q = (x - 3)^2 + 3 we have EXP(x) = p / q, which gives
+
+    sigmoid(x) = p / (p + q)
+    tanh(x)    = ((p - q) * (p + q)) / (p^2 + q^2)
+
+so every element costs a single division.
+*/
+
+static void scalar_sigmoid(const double * a, double * c, unsigned int length){
+    for(size_t i = 0; i < length; i++){
+        c[i] = sigmoid(a[i]);
+    }
+}
+
+static void scalar_tanh(const double * a, double * c, unsigned int length){
+    for(size_t i = 0; i < length; i++){
+        c[i] = tanh(a[i]);
+    }
+}
+
+static void scalar_add(const double * a, const double * b, double * c, unsigned int length){
+    for(size_t i = 0; i < length; i++){
+        c[i] = a[i] + b[i];
+    }
+}
+
+static void scalar_mul(const double * a, const double * b, double * c, unsigned int length){
+    for(size_t i = 0; i < length; i++){
+        c[i] = a[i] * b[i];
+    }
+}
+
+#define DEFINE_LSTM_GATES(prefix)                                           \
+static void prefix ## _lstm_gates(const double * a, double * c, unsigned int length){ \
+    unsigned int slice = length / 4;                                        \
+    prefix ## _sigmoid(a, c, 2 * slice);                                    \
+    prefix ## _tanh(a + 2 * slice, c + 2 * slice, slice);                   \
+    prefix ## _sigmoid(a + 3 * slice, c + 3 * slice, slice);                \
+}
+
+DEFINE_LSTM_GATES(scalar)
+
+static const simd_ops scalar_ops = {
+    .isa = SIMD_SCALAR, .name = "scalar",
+    .sigmoid = scalar_sigmoid, .tanh = scalar_tanh, .lstm_gates = scalar_lstm_gates,
+    .add = scalar_add, .mul = scalar_mul,
+};
+
+#if SIMD_X86
+
+/*
+SSE2, 2 doubles per register. Part of the x86-64 baseline so it needs no target attribute
+*/
+
+static inline __m128d sse2_pq_sigmoid(__m128d x){
+    __m128d three = _mm_set1_pd(3.0);
+    __m128d xp = _mm_add_pd(x, three);
+    __m128d xm = _mm_sub_pd(x, three);
+    __m128d p = _mm_add_pd(_mm_mul_pd(xp, xp), three);
+    __m128d q = _mm_add_pd(_mm_mul_pd(xm, xm), three);
+    return _mm_div_pd(p, _mm_add_pd(p, q));
+}
+
+static inline __m128d sse2_pq_tanh(__m128d x){
+    __m128d three = _mm_set1_pd(3.0);
+    __m128d xp = _mm_add_pd(x, three);
+    __m128d xm = _mm_sub_pd(x, three);
+    __m128d p = _mm_add_pd(_mm_mul_pd(xp, xp), three);
+    __m128d q = _mm_add_pd(_mm_mul_pd(xm, xm), three);
+    __m128d num = _mm_mul_pd(_mm_sub_pd(p, q), _mm_add_pd(p, q));
+    __m128d den = _mm_add_pd(_mm_mul_pd(p, p), _mm_mul_pd(q, q));
+    return _mm_div_pd(num, den);
+}
+
+static void sse2_sigmoid(const double * a, double * c, unsigned int length){
+    size_t i = 0;
+    for(; i + 2 <= length; i += 2){
+        _mm_storeu_pd(c + i, sse2_pq_sigmoid(_mm_loadu_pd(a + i)));
+    }
+    scalar_sigmoid(a + i, c + i, length - i);
+}
+
+static void sse2_tanh(const double * a, double * c, unsigned int length){
+    size_t i = 0;
+    for(; i + 2 <= length; i += 2){
+        _mm_storeu_pd(c + i, sse2_pq_tanh(_mm_loadu_pd(a + i)));
+    }
+    scalar_tanh(a + i, c + i, length - i);
+}
+
+static void sse2_add(const double * a, const double * b, double * c, unsigned int length){
+    size_t i = 0;
+    for(; i + 2 <= length; i += 2){
+        _mm_storeu_pd(c + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    }
+    scalar_add(a + i, b + i, c + i, length - i);
+}
+
+static void sse2_mul(const double * a, const double * b, double * c, unsigned int length){
+    size_t i = 0;
+    for(; i + 2 <= length; i += 2){
+        _mm_storeu_pd(c + i, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    }
+    scalar_mul(a + i, b + i, c + i, length - i);
+}
+
+DEFINE_LSTM_GATES(sse2)
+
+static const simd_ops sse2_ops = {
+    .isa = SIMD_SSE2, .name = "sse2",
+    .sigmoid = sse2_sigmoid, .tanh = sse2_tanh, .lstm_gates = sse2_lstm_gates,
+    .add = sse2_add, .mul = sse2_mul,
+};
+
+/*
+AVX2 + FMA, 4 doubles per register
+*/
+
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+
+AVX2_TARGET static inline __m256d avx2_pq_sigmoid(__m256d x){
+    __m256d three = _mm256_set1_pd(3.0);
+    __m256d xp = _mm256_add_pd(x, three);
+    __m256d xm = _mm256_sub_pd(x, three);
+    __m256d p = _mm256_fmadd_pd(xp, xp, three);
+    __m256d q = _mm256_fmadd_pd(xm, xm, three);
+    return _mm256_div_pd(p, _mm256_add_pd(p, q));
+}
+
+AVX2_TARGET static inline __m256d avx2_pq_tanh(__m256d x){
+    __m256d three = _mm256_set1_pd(3.0);
+    __m256d xp = _mm256_add_pd(x, three);
+    __m256d xm = _mm256_sub_pd(x, three);
+    __m256d p = _mm256_fmadd_pd(xp, xp, three);
+    __m256d q = _mm256_fmadd_pd(xm, xm, three);
+    __m256d num = _mm256_mul_pd(_mm256_sub_pd(p, q), _mm256_add_pd(p, q));
+    __m256d den = _mm256_fmadd_pd(p, p, _mm256_mul_pd(q, q));
+    return _mm256_div_pd(num, den);
+}
+
+AVX2_TARGET static void avx2_sigmoid(const double * a, double * c, unsigned int length){
+    size_t i = 0;
+    for(; i + 4 <= length; i += 4){
+        _mm256_storeu_pd(c + i, avx2_pq_sigmoid(_mm256_loadu_pd(a + i)));
+    }
+    scalar_sigmoid(a + i, c + i, length - i);
+}
+
+AVX2_TARGET static void avx2_tanh(const double * a, double * c, unsigned int length){
+    size_t i = 0;
+    for(; i + 4 <= length; i += 4){
+        _mm256_storeu_pd(c + i, avx2_pq_tanh(_mm256_loadu_pd(a + i)));
+    }
+    scalar_tanh(a + i, c + i, length - i);
+}
+
+AVX2_TARGET static void avx2_add(const double * a, const double * b, double * c, unsigned int length){
+    size_t i = 0;
+    for(; i + 4 <= length; i += 4){
+        _mm256_storeu_pd(c + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    scalar_add(a + i, b + i, c + i, length - i);
+}
+
+AVX2_TARGET static void avx2_mul(const double * a, const double * b, double * c, unsigned int length){
+    size_t i = 0;
+    for(; i + 4 <= length; i += 4){
+        _mm256_storeu_pd(c + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    scalar_mul(a + i, b + i, c + i, length - i);
+}
+
+DEFINE_LSTM_GATES(avx2)
+
+static const simd_ops avx2_ops = {
+    .isa = SIMD_AVX2, .name = "avx2",
+    .sigmoid = avx2_sigmoid, .tanh = avx2_tanh, .lstm_gates = avx2_lstm_gates,
+    .add = avx2_add, .mul = avx2_mul,
+};
+
+/*
+AVX-512F, 8 doubles per register, the tail is handled with a masked load/store instead of scalar code
+*/
+
+#define AVX512_TARGET __attribute__((target("avx512f")))
+
+AVX512_TARGET static inline __m512d avx512_pq_sigmoid(__m512d x){
+    __m512d three = _mm512_set1_pd(3.0);
+    __m512d xp = _mm512_add_pd(x, three);
+    __m512d xm = _mm512_sub_pd(x, three);
+    __m512d p = _mm512_fmadd_pd(xp, xp, three);
+    __m512d q = _mm512_fmadd_pd(xm, xm, three);
+    return _mm512_div_pd(p, _mm512_add_pd(p, q));
+}
+
+AVX512_TARGET static inline __m512d avx512_pq_tanh(__m512d x){
+    __m512d three = _mm512_set1_pd(3.0);
+    __m512d xp = _mm512_add_pd(x, three);
+    __m512d xm = _mm512_sub_pd(x, three);
+    __m512d p = _mm512_fmadd_pd(xp, xp, three);
+    __m512d q = _mm512_fmadd_pd(xm, xm, three);
+    __m512d num = _mm512_mul_pd(_mm512_sub_pd(p, q), _mm512_add_pd(p, q));
+    __m512d den = _mm512_fmadd_pd(p, p, _mm512_mul_pd(q, q));
+    return _mm512_div_pd(num, den);
+}
+
+AVX512_TARGET static inline __mmask8 avx512_tail_mask(size_t remaining){
+    return (__mmask8)((1u << remaining) - 1);
+}
+
+AVX512_TARGET static void avx512_sigmoid(const double * a, double * c, unsigned int length){
+    size_t i = 0;
+    for(; i + 8 <= length; i += 8){
+        _mm512_storeu_pd(c + i, avx512_pq_sigmoid(_mm512_loadu_pd(a + i)));
+    }
+    if(i < length){
+        __mmask8 mask = avx512_tail_mask(length - i);
+        __m512d x = _mm512_mask_loadu_pd(_mm512_setzero_pd(), mask, a + i);
+        _mm512_mask_storeu_pd(c + i, mask, avx512_pq_sigmoid(x));
+    }
+}
+
+AVX512_TARGET static void avx512_tanh(const double * a, double * c, unsigned int length){
+    size_t i = 0;
+    for(; i + 8 <= length; i += 8){
+        _mm512_storeu_pd(c + i, avx512_pq_tanh(_mm512_loadu_pd(a + i)));
+    }
+    if(i < length){
+        __mmask8 mask = avx512_tail_mask(length - i);
+        __m512d x = _mm512_mask_loadu_pd(_mm512_setzero_pd(), mask, a + i);
+        _mm512_mask_storeu_pd(c + i, mask, avx512_pq_tanh(x));
+    }
+}
+
+AVX512_TARGET static void avx512_add(const double * a, const double * b, double * c, unsigned int length){
+    size_t i = 0;
+    for(; i + 8 <= length; i += 8){
+        _mm512_storeu_pd(c + i, _mm512_add_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+    }
+    if(i < length){
+        __mmask8 mask = avx512_tail_mask(length - i);
+        __m512d x = _mm512_maskz_loadu_pd(mask, a + i);
+        __m512d y = _mm512_maskz_loadu_pd(mask, b + i);
+        _mm512_mask_storeu_pd(c + i, mask, _mm512_add_pd(x, y));
+    }
+}
+
+AVX512_TARGET static void avx512_mul(const double * a, const double * b, double * c, unsigned int length){
+    size_t i = 0;
+    for(; i + 8 <= length; i += 8){
+        _mm512_storeu_pd(c + i, _mm512_mul_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+    }
+    if(i < length){
+        __mmask8 mask = avx512_tail_mask(length - i);
+        __m512d x = _mm512_maskz_loadu_pd(mask, a + i);
+        __m512d y = _mm512_maskz_loadu_pd(mask, b + i);
+        _mm512_mask_storeu_pd(c + i, mask, _mm512_mul_pd(x, y));
+    }
+}
+
+DEFINE_LSTM_GATES(avx512)
+
+static const simd_ops avx512_ops = {
+    .isa = SIMD_AVX512, .name = "avx512",
+    .sigmoid = avx512_sigmoid, .tanh = avx512_tanh, .lstm_gates = avx512_lstm_gates,
+    .add = avx512_add, .mul = avx512_mul,
+};
+
+#endif // SIMD_X86
+
+static inline float sigmoid_f32(float x){
+    float p = ((x + 3) * (x + 3)) + 3;
+    float q = ((x - 3) * (x - 3)) + 3;
+    return p/(p + q);
+}
+
+static inline float tanh_f32(float x){
+    float p = ((x + 3) * (x + 3)) + 3;
+    float q = ((x - 3) * (x - 3)) + 3;
+    return ((p - q) * (p + q))/((p * p) + (q * q));
+}
+
+SIMD_TARGET_CLONES void simd_sigmoid_f32(const float * a, float * c, unsigned int length){
+    for(size_t i = 0; i < length; i++){
+        c[i] = sigmoid_f32(a[i]);
+    }
+}
+
+SIMD_TARGET_CLONES void simd_tanh_f32(const float * a, float * c, unsigned int length){
+    for(size_t i = 0; i < length; i++){
+        c[i] = tanh_f32(a[i]);
+    }
+}
+
+void simd_lstm_gates_f32(const float * a, float * c, unsigned int length){
+    unsigned int slice = length / 4;
+    simd_sigmoid_f32(a, c, 2 * slice);
+    simd_tanh_f32(a + 2 * slice, c + 2 * slice, slice);
+    simd_sigmoid_f32(a + 3 * slice, c + 3 * slice, slice);
+}
+
+SIMD_TARGET_CLONES void simd_add_f32(const float * a, const float * b, float * c, unsigned int length){
+    for(size_t i = 0; i < length; i++){
+        c[i] = a[i] + b[i];
+    }
+}
+
+SIMD_TARGET_CLONES void simd_mul_f32(const float * a, const float * b, float * c, unsigned int length){
+    for(size_t i = 0; i < length; i++){
+        c[i] = a[i] * b[i];
+    }
+}
+
+/*
+Values and derivatives of the rational sigmoid and tanh at x. With p' = 2 (x + 3) and q' = 2 (x - 3)
+we get p' q - p q' = 12 (12 - x^2) and the quotient rule gives
+
+    sigmoid'(x) = 12 (12 - x^2) / (p + q)^2
+    tanh'(x)    = 48 p q (12 - x^2) / (p^2 + q^2)^2
+
+Both approximations turn back towards 1/2 and 0 for large |x|, so unlike the exact functions their
+derivatives do not follow from the outputs and are taken at the pre-activations
+*/
+#define ACTIVATION_GRADIENTS(type, suffix) \
+static inline type sigmoid_gradient ## suffix(type x, type * d){ \
+    type p = ((x + 3) * (x + 3)) + 3; \
+    type q = ((x - 3) * (x - 3)) + 3; \
+    type r = 1 / (p + q); \
+    *d = 12 * (12 - x * x) * r * r; \
+    return p * r; \
+} \
+static inline type tanh_gradient ## suffix(type x, type * d){ \
+    type p = ((x + 3) * (x + 3)) + 3; \
+    type q = ((x - 3) * (x - 3)) + 3; \
+    type r = 1 / ((p * p) + (q * q)); \
+    *d = 48 * p * q * (12 - x * x) * r * r; \
+    return (p - q) * (p + q) * r; \
+}
+
+ACTIVATION_GRADIENTS(double, )
+ACTIVATION_GRADIENTS(float, _f32)
+
+/*
+The gate activations are recomputed from the pre-activations along with their derivatives, tanh(c) from c
+*/
+#define LSTM_CELL_BACKWARD(name, type, suffix) \
+SIMD_TARGET_CLONES void name(const type * const pre_gates[4], const type * c_prev, const type * c, const type * dh, \
+    type * dc, type * const d_gates[4], unsigned int length){ \
+    for(size_t k = 0; k < length; k++){ \
+        type df, di, dg, d_o, d_tc; \
+        type f = sigmoid_gradient ## suffix(pre_gates[0][k], &df); \
+        type i = sigmoid_gradient ## suffix(pre_gates[1][k], &di); \
+        type g = tanh_gradient ## suffix(pre_gates[2][k], &dg); \
+        type o = sigmoid_gradient ## suffix(pre_gates[3][k], &d_o); \
+        type tc = tanh_gradient ## suffix(c[k], &d_tc); \
+        type d_cell = dc[k] + dh[k] * o * d_tc; \
+        d_gates[0][k] = d_cell * c_prev[k] * df; \
+        d_gates[1][k] = d_cell * g * di; \
+        d_gates[2][k] = d_cell * i * dg; \
+        d_gates[3][k] = dh[k] * tc * d_o; \
+        dc[k] = d_cell * f; \
+    } \
+}
+
+LSTM_CELL_BACKWARD(simd_lstm_cell_backward, double, )
+LSTM_CELL_BACKWARD(simd_lstm_cell_backward_f32, float, _f32)
+
+const simd_ops * simd_ops_for(simd_isa isa){
+    switch(isa){
+        case SIMD_SCALAR:
+            return &scalar_ops;
+#if SIMD_X86
+        case SIMD_SSE2:
+            return &sse2_ops;
+        case SIMD_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? &avx2_ops : NULL;
+        case SIMD_AVX512:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx512f") ? &avx512_ops : NULL;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+static simd_isa simd_isa_from_env(void){
+    const char * name = getenv("LSTM_SIMD");
+
+    if(name == NULL){
+        return SIMD_AVX512;
+    }
+
+    const char * names[] = {"scalar", "sse2", "avx2", "avx512"};
+    for(size_t i = 0; i < ARRAY_LENGTH(names); i++){
+        if(strcmp(name, names[i]) == 0){
+            return (simd_isa)i;
+        }
+    }
+
+    PANIC("Unknown LSTM_SIMD value %s\n", name);
+}
+
+static const simd_ops * active_ops = NULL;
+
+/*
+Picks the widest supported isa not above the LSTM_SIMD limit. Runs before main so later calls never race on it
+*/
+__attribute__((constructor)) static void simd_init(void){
+    for(int isa = simd_isa_from_env(); isa >= SIMD_SCALAR; isa--){
+        const simd_ops * ops = simd_ops_for((simd_isa)isa);
+        if(ops != NULL){
+            active_ops = ops;
+            return;
+        }
+    }
+}
+
+const simd_ops * simd_get_ops(void){
+    if(active_ops == NULL){
+        simd_init();
+    }
+
+    return active_ops;
+}
\ No newline at end of file
@@ -0,0 +1,254 @@
+#include "stack.h"
+#include "thread_pool.h"
+
+static void lstm_stack_state_cleanup(lstm_stack * self){
+    for(int l = 0; l < self->layers; l++){
+        lstm_session_cleanup(self->sessions[l]);
+    }
+
+    for(int i = 0; i < (self->layers - 1) * LSTM_STACK_RING; i++){
+        tensor_cleanup(self->ring[i]);
+    }
+
+    tensor_cleanup(self->input);
+    tensor_cleanup(self->output_view);
+}
+
+static void lstm_stack_state_init(lstm_stack * self, int batch_size){
+    self->batch_size = batch_size;
+
+    for(int l = 0; l < self->layers; l++){
+        self->sessions[l] = lstm_session_init_with_weights(self->weights[l], batch_size);
+    }
+
+    // same dtype as the activations of the sessions
+    dtype type = tensor_dtype(self->sessions[0]->cell_state);
+
+    int ring_shape[2] = {self->hidden_size, batch_size};
+    for(int i = 0; i < (self->layers - 1) * LSTM_STACK_RING; i++){
+        self->ring[i] = tensor_init_with_dtype(2, ring_shape, type);
+    }
+
+    int input_shape[2] = {self->features, batch_size};
+    self->input = tensor_init_with_dtype(2, input_shape, type);
+    self->output_view = tensor_view(self->input);
+}
+
+lstm_stack * lstm_stack_init(int layers, int features, int hidden_size, int output_size, int flags){
+    TENSOR_CHECK(layers < 1, "A stack needs at least 1 layer, got %d", layers);
+    TENSOR_CHECK(features < 1, "Features should at least be 1, got %d", features);
+    TENSOR_CHECK(output_size < 1, "Output size should at least be 1, got %d", output_size);
+
+    lstm_stack * stack = (lstm_stack *)SAFE_MALLOC(sizeof(lstm_stack));
+    stack->layers = layers;
+    stack->features = features;
+    stack->hidden_size = hidden_size;
+    stack->output_size = output_size;
+    stack->flags = flags;
+
+    stack->weights = (lstm_weights **)SAFE_MALLOC(sizeof(lstm_weights *) * layers);
+    for(int l = 0; l < layers; l++){
+        int inputs = l == 0 ? features : hidden_size;
+        int outputs = l == layers - 1 ? output_size : 0;
+        stack->weights[l] = lstm_weights_init(inputs + hidden_size, hidden_size, outputs, flags);
+    }
+
+    stack->sessions = (lstm_session **)SAFE_MALLOC(sizeof(lstm_session *) * layers);
+    stack->ring = (tensor **)SAFE_MALLOC(sizeof(tensor *) * layers * LSTM_STACK_RING);
+    stack->progress = (atomic_int *)SAFE_MALLOC(sizeof(atomic_int) * layers);
+    stack->busy = (atomic_int *)SAFE_MALLOC(sizeof(atomic_int) * layers);
+    pthread_mutex_init(&stack->lock, NULL);
+    pthread_cond_init(&stack->wake, NULL);
+
+    lstm_stack_state_init(stack, 1);
+
+    return stack;
+}
+
+/*
+Whether layer may run its next step: its input is written and the slot its h goes to has been read
+*/
+static inline int lstm_stack_ready(lstm_stack * self, int layer){
+    int step = atomic_load_explicit(&self->progress[layer], memory_order_relaxed);
+
+    if(step >= self->rows){
+        return 0;
+    }
+
+    if(layer > 0 && atomic_load_explicit(&self->progress[layer - 1], memory_order_acquire) <= step){
+        return 0;
+    }
+
+    if(layer < self->layers - 1 && step - atomic_load_explicit(&self->progress[layer + 1], memory_order_acquire) >= LSTM_STACK_RING){
+        return 0;
+    }
+
+    return 1;
+}
+
+static void lstm_stack_cell(lstm_stack * self, int layer, int step){
+    lstm_session * session = self->sessions[layer];
+    int slot = step % LSTM_STACK_RING;
+
+    tensor * input = self->input;
+    if(layer == 0){
+        tensor_select_batch(self->input, self->inputs, step, self->rows);
+    }else{
+        input = self->ring[(layer - 1) * LSTM_STACK_RING + slot];
+    }
+
+    if(layer == self->layers - 1){
+        tensor * output = tensor_slice(self->output_view, self->outputs, 0, step * self->output_size, self->output_size);
+        lstm_step(session, input, output);
+    }else{
+        lstm_step(session, input, NULL);
+        // h is overwritten by the next step, the layer above reads its own copy
+        tensor_convert(self->ring[layer * LSTM_STACK_RING + slot], session->hidden_state);
+    }
+}
+
+/*
+Tells parked workers a layer may have become ready. The counter is bumped before sleepers is read and a
+sleeper counts itself before it reads the counter, so either the sleeper sees the change or it gets the broadcast
+*/
+static void lstm_stack_signal(lstm_stack * self){
+    atomic_fetch_add(&self->changes, 1);
+
+    if(atomic_load(&self->sleepers) > 0){
+        pthread_mutex_lock(&self->lock);
+        pthread_cond_broadcast(&self->wake);
+        pthread_mutex_unlock(&self->lock);
+    }
+}
+
+/*
+Sleeps until the counter moves past seen or every layer is done
+*/
+static void lstm_stack_park(lstm_stack * self, int seen){
+    pthread_mutex_lock(&self->lock);
+    atomic_fetch_add(&self->sleepers, 1);
+
+    while(atomic_load(&self->changes) == seen && atomic_load(&self->finished) < self->layers){
+        pthread_cond_wait(&self->wake, &self->lock);
+    }
+
+    atomic_fetch_sub(&self->sleepers, 1);
+    pthread_mutex_unlock(&self->lock);
+}
+
+/*
+Every thread loops over the layers, deepest first so ring slots free up early, and claims whichever is ready.
+A claimed layer keeps stepping while its inputs allow, which keeps its weights hot in that core's cache.
+A thread that finds nothing to run for LSTM_STACK_SPINS scans parks instead of burning its core
+*/
+static void lstm_stack_worker(int begin, int end, void * context){
+    (void)begin;
+    (void)end;
+
+    lstm_stack * self = (lstm_stack *)context;
+    int spins = 0;
+
+    while(atomic_load_explicit(&self->finished, memory_order_acquire) < self->layers){
+        // read before the scan so a step landing during it keeps the park below from sleeping
+        int seen = atomic_load(&self->changes);
+        int ran = 0;
+
+        for(int l = self->layers - 1; l >= 0; l--){
+            if(!lstm_stack_ready(self, l)){
+                continue;
+            }
+
+            int idle = 0;
+            if(!atomic_compare_exchange_strong(&self->busy[l], &idle, 1)){
+                continue;
+            }
+
+            while(lstm_stack_ready(self, l)){
+                int step = atomic_load_explicit(&self->progress[l], memory_order_relaxed);
+                lstm_stack_cell(self, l, step);
+
+                atomic_store_explicit(&self->progress[l], step + 1, memory_order_release);
+                if(step + 1 == self->rows){
+                    atomic_fetch_add_explicit(&self->finished, 1, memory_order_release);
+                }
+
+                lstm_stack_signal(self);
+                ran = 1;
+            }
+
+            atomic_store_explicit(&self->busy[l], 0, memory_order_release);
+            // another thread may have seen the layer ready while it was claimed
+            lstm_stack_signal(self);
+        }
+
+        if(ran){
+            spins = 0;
+        }else if(++spins >= LSTM_STACK_SPINS){
+            lstm_stack_park(self, seen);
+            spins = 0;
+        }
+    }
+}
+
+void lstm_stack_infer(lstm_stack * self, tensor * inputs, int batch, tensor * outputs){
+    TENSOR_EXIST(inputs);
+    TENSOR_EXIST(outputs);
+    TENSOR_CHECK(batch < 1, "Batch size should at least be 1, got %d", batch);
+
+    int * input_shape = tensor_shape(inputs);
+    TENSOR_CHECK(input_shape[0] % batch != 0, "Input rows %d not divisible by batch %d", input_shape[0], batch);
+    TENSOR_CHECK(input_shape[1] != self->features, "Inputs should have %d features, got %d", self->features, input_shape[1]);
+
+    int rows = input_shape[0] / batch;
+
+    int * output_shape = tensor_shape(outputs);
+    TENSOR_CHECK(output_shape[0] != rows * self->output_size || output_shape[1] != batch, 
+        "Output buffer should be [%d x %d], got [%d x %d]", rows * self->output_size, batch, output_shape[0], output_shape[1]
+    );
+
+    if(self->batch_size != batch){
+        lstm_stack_state_cleanup(self);
+        lstm_stack_state_init(self, batch);
+    }
+
+    for(int l = 0; l < self->layers; l++){
+        lstm_session_reset(self->sessions[l]);
+        atomic_init(&self->progress[l], 0);
+        atomic_init(&self->busy[l], 0);
+    }
+
+    atomic_init(&self->finished, 0);
+    atomic_init(&self->changes, 0);
+    atomic_init(&self->sleepers, 0);
+    self->inputs = inputs;
+    self->outputs = outputs;
+    self->rows = rows;
+
+    // one loop per layer at most, any thread count finishes since some layer is always ready
+    int threads = thread_pool_threads();
+    thread_pool_parallel_for(threads < self->layers ? threads : self->layers, 1, lstm_stack_worker, self);
+
+    self->inputs = NULL;
+    self->outputs = NULL;
+}
+
+void lstm_stack_cleanup(lstm_stack * self){
+    if(self == NULL){
+        return;
+    }
+
+    lstm_stack_state_cleanup(self);
+
+    for(int l = 0; l < self->layers; l++){
+        lstm_weights_release(self->weights[l]);
+    }
+
+    SAFE_FREE(self->weights);
+    SAFE_FREE(self->sessions);
+    SAFE_FREE(self->ring);
+    SAFE_FREE(self->progress);
+    SAFE_FREE(self->busy);
+    pthread_mutex_destroy(&self->lock);
+    pthread_cond_destroy(&self->wake);
+    SAFE_FREE(self);
+}
\ No newline at end of file
@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+#include "utils.h"
+
+typedef struct thread_pool{
+    pthread_t * workers;
+    int worker_count;
+    int pin;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    // one loop at a time, callers that find it taken run inline
+    pthread_mutex_t submit;
+
+    // current loop
+    thread_pool_range_fn fn;
+    void * context;
+    int n;
+    int block;
+    int chunks;
+    atomic_int next_chunk;
+    int pending;
+
+    unsigned long generation;
+    int stop;
+} thread_pool;
+
+static thread_pool pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+    .submit = PTHREAD_MUTEX_INITIALIZER,
+};
+
+// -1 until the pool is created, written under pool.submit
+static atomic_int pool_threads = -1;
+
+static int online_cpus(void){
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+static int env_int(const char * name, int fallback){
+    const char * value = getenv(name);
+    return value != NULL ? atoi(value) : fallback;
+}
+
+static int env_threads(void){
+    int threads = env_int("LSTM_THREADS", 0);
+    return threads > 0 ? threads : online_cpus();
+}
+
+static void run_chunks(void){
+    int chunk;
+    while((chunk = atomic_fetch_add(&pool.next_chunk, 1)) < pool.chunks){
+        int begin = chunk * pool.block;
+        int end = begin + pool.block < pool.n ? begin + pool.block : pool.n;
+        pool.fn(begin, end, pool.context);
+    }
+}
+
+static void pin_to_cpu(int cpu){
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % online_cpus(), &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)cpu;
+#endif
+}
+
+static void * worker_main(void * argument){
+    int index = (int)(long)argument;
+    unsigned long seen = 0;
+
+    if(pool.pin){
+        // cpu 0 is left to the calling thread
+        pin_to_cpu(index + 1);
+    }
+
+    for(;;){
+        pthread_mutex_lock(&pool.lock);
+        while(!pool.stop && pool.generation == seen){
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        }
+
+        if(pool.stop){
+            pthread_mutex_unlock(&pool.lock);
+            return NULL;
+        }
+
+        seen = pool.generation;
+        pthread_mutex_unlock(&pool.lock);
+
+        run_chunks();
+
+        pthread_mutex_lock(&pool.lock);
+        if(--pool.pending == 0){
+            pthread_cond_signal(&pool.done);
+        }
+        pthread_mutex_unlock(&pool.lock);
+    }
+}
+
+/*
+Expects pool.submit to be held
+*/
+static void pool_start(int threads, int pin){
+    if(threads <= 0){
+        threads = online_cpus();
+    }
+
+    pool.worker_count = threads - 1;
+    pool.pin = pin;
+    pool.stop = 0;
+    pool.workers = pool.worker_count > 0 ? (pthread_t *)SAFE_MALLOC(sizeof(pthread_t) * pool.worker_count) : NULL;
+
+    for(int i = 0; i < pool.worker_count; i++){
+        if(pthread_create(&pool.workers[i], NULL, worker_main, (void *)(long)i) != 0){
+            PANIC("Failed to start worker %d of the thread pool\n", i);
+        }
+    }
+
+    pool_threads = threads;
+}
+
+/*
+Expects pool.submit to be held
+*/
+static void pool_stop(void){
+    if(pool_threads < 0){
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = 1;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    for(int i = 0; i < pool.worker_count; i++){
+        pthread_join(pool.workers[i], NULL);
+    }
+
+    SAFE_FREE(pool.workers);
+    pool.workers = NULL;
+    pool.worker_count = 0;
+    pool_threads = -1;
+}
+
+void thread_pool_parallel_for(int n, int block, thread_pool_range_fn fn, void * context){
+    if(n <= 0){
+        return;
+    }
+
+    block = block < 1 ? 1 : block;
+    int chunks = (n + block - 1) / block;
+
+    if(chunks == 1 || pthread_mutex_trylock(&pool.submit) != 0){
+        fn(0, n, context);
+        return;
+    }
+
+    if(pool_threads < 0){
+        pool_start(env_threads(), env_int("LSTM_PIN", 0));
+    }
+
+    if(pool.worker_count == 0){
+        pthread_mutex_unlock(&pool.submit);
+        fn(0, n, context);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.fn = fn;
+    pool.context = context;
+    pool.n = n;
+    pool.block = block;
+    pool.chunks = chunks;
+    atomic_store(&pool.next_chunk, 0);
+    pool.pending = pool.worker_count;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    run_chunks();
+
+    pthread_mutex_lock(&pool.lock);
+    while(pool.pending > 0){
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    pthread_mutex_unlock(&pool.submit);
+}
+
+int thread_pool_threads(void){
+    // never waits on a running loop, before the first loop this is the size the pool will start with
+    int threads = pool_threads;
+    return threads > 0 ? threads : env_threads();
+}
+
+void thread_pool_configure(int threads, int pin){
+    pthread_mutex_lock(&pool.submit);
+    pool_stop();
+    pool_start(threads, pin);
+    pthread_mutex_unlock(&pool.submit);
+}
+
+void thread_pool_shutdown(void){
+    pthread_mutex_lock(&pool.submit);
+    pool_stop();
+    pthread_mutex_unlock(&pool.submit);
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+/*
+Minimal harness of the make test programs: a failed check prints where and why, the program exits
+non-zero when any check failed
+*/
+
+static int test_failures = 0;
+
+#define TEST_CHECK(condition, ...) do{                          \
+    if(!(condition)){                                           \
+        fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);         \
+        fprintf(stderr, __VA_ARGS__);                           \
+        fprintf(stderr, "\n");                                  \
+        test_failures++;                                        \
+    }                                                           \
+}while(0)
+
+/*
+Deterministic values in [-1, 1), tensor_fill_rand is unseeded so runs would not repeat
+*/
+static inline double test_random(unsigned long long * state){
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (double)(*state >> 11) / (double)(1ULL << 52) - 1.0;
+}
+
+static inline int test_report(const char * name){
+    if(test_failures == 0){
+        printf("%s: ok\n", name);
+    }else{
+        printf("%s: %d failure(s)\n", name, test_failures);
+    }
+
+    return test_failures == 0 ? 0 : 1;
+}
+
+#endif // TEST_H
\ No newline at end of file
@@ -0,0 +1,267 @@
+#include <string.h>
+
+#include "gemm.h"
+#include "mat_ops.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+#include "test.h"
+
+/*
+Compares the blocked engines with matrix_multiplication, the naive loop they replaced, on edge sizes around
+the register and cache tiles and on every operand layout the tensor views produce
+*/
+
+typedef enum layout{
+    LAYOUT_ROW_MAJOR,
+    // a stored as [k x m], b as [n x k]
+    LAYOUT_TRANSPOSED,
+    // every other column, rows padded
+    LAYOUT_STRIDED,
+    // one row of b repeated k times, the stride 0 of a broadcast view
+    LAYOUT_BROADCAST,
+    LAYOUT_COUNT,
+} layout;
+
+static const char * const layout_names[LAYOUT_COUNT] = {"row major", "transposed", "strided", "broadcast"};
+
+typedef struct operand{
+    double * data;
+    int rs;
+    int cs;
+} operand;
+
+/*
+A [rows x cols] operand in the given layout filled with deterministic values
+*/
+static operand operand_init(int rows, int cols, layout l, int is_b, unsigned long long * seed){
+    operand o;
+    size_t size;
+
+    if(l == LAYOUT_TRANSPOSED){
+        o = (operand){NULL, 1, rows};
+        size = (size_t)rows * cols;
+    }else if(l == LAYOUT_STRIDED){
+        o = (operand){NULL, 2 * cols + 3, 2};
+        size = (size_t)rows * (2 * cols + 3);
+    }else if(l == LAYOUT_BROADCAST && is_b){
+        o = (operand){NULL, 0, 1};
+        size = cols;
+    }else{
+        // only b is broadcast
+        o = (operand){NULL, cols, 1};
+        size = (size_t)rows * cols;
+    }
+
+    o.data = (double *)SAFE_MALLOC(sizeof(double) * size);
+    for(size_t i = 0; i < size; i++){
+        o.data[i] = test_random(seed);
+    }
+
+    return o;
+}
+
+/*
+Row-major copy of an operand for matrix_multiplication
+*/
+static double * operand_dense(operand o, int rows, int cols){
+    double * dense = (double *)SAFE_MALLOC(sizeof(double) * rows * cols);
+
+    for(int i = 0; i < rows; i++){
+        for(int j = 0; j < cols; j++){
+            dense[i * cols + j] = o.data[(long)i * o.rs + (long)j * o.cs];
+        }
+    }
+
+    return dense;
+}
+
+static double * reference(int m, int n, int k, operand a, operand b){
+    double * dense_a = operand_dense(a, m, k);
+    double * dense_b = operand_dense(b, k, n);
+    double * c = (double *)SAFE_MALLOC(sizeof(double) * m * n);
+
+    matrix_multiplication(dense_a, dense_b, c, m, k, n);
+
+    SAFE_FREE(dense_a);
+    SAFE_FREE(dense_b);
+    return c;
+}
+
+/*
+Largest difference over the [m x n] block of c with row stride ldc, the operands are in [-1, 1) so
+|c| <= k and the bound scales with k
+*/
+static double max_error(int m, int n, const void * c, dtype type, int ldc, const double * expected){
+    double error = 0.0;
+
+    for(int i = 0; i < m; i++){
+        for(int j = 0; j < n; j++){
+            double d = dtype_get(c, type, (size_t)i * ldc + j) - expected[i * n + j];
+            d = d < 0 ? -d : d;
+            error = d > error ? d : error;
+        }
+    }
+
+    return error;
+}
+
+static void test_gemm_strided(int m, int n, int k, layout l, unsigned long long * seed){
+    operand a = operand_init(m, k, l, 0, seed);
+    operand b = operand_init(k, n, l, 1, seed);
+    double * expected = reference(m, n, k, a, b);
+
+    // c is a block of a wider buffer, the columns past n must survive
+    int ldc = n + 5;
+    double * c = (double *)SAFE_MALLOC(sizeof(double) * m * ldc);
+    for(int i = 0; i < m * ldc; i++){
+        c[i] = 1e300;
+    }
+
+    gemm_strided(m, n, k, a.data, a.rs, a.cs, b.data, b.rs, b.cs, c, ldc, 0);
+
+    double error = max_error(m, n, c, DTYPE_F64, ldc, expected);
+    TEST_CHECK(error <= 1e-13 * k, "gemm_strided %dx%dx%d %s: error %g", m, n, k, layout_names[l], error);
+
+    int untouched = 1;
+    for(int i = 0; i < m; i++){
+        for(int j = n; j < ldc; j++){
+            untouched &= c[i * ldc + j] == 1e300;
+        }
+    }
+    TEST_CHECK(untouched, "gemm_strided %dx%dx%d %s: wrote past the n columns", m, n, k, layout_names[l]);
+
+    // accumulating onto the product just stored doubles it
+    gemm_strided(m, n, k, a.data, a.rs, a.cs, b.data, b.rs, b.cs, c, ldc, 1);
+    double * doubled = (double *)SAFE_MALLOC(sizeof(double) * m * n);
+    for(int i = 0; i < m * n; i++){
+        doubled[i] = 2 * expected[i];
+    }
+    error = max_error(m, n, c, DTYPE_F64, ldc, doubled);
+    TEST_CHECK(error <= 2e-13 * k, "gemm_strided accumulate %dx%dx%d %s: error %g", m, n, k, layout_names[l], error);
+
+    if(l == LAYOUT_ROW_MAJOR){
+        memset(c, 0, sizeof(double) * m * ldc);
+        gemm(m, n, k, a.data, a.rs, b.data, b.rs, c, ldc);
+        error = max_error(m, n, c, DTYPE_F64, ldc, expected);
+        TEST_CHECK(error <= 1e-13 * k, "gemm %dx%dx%d: error %g", m, n, k, error);
+    }
+
+    if(n == 1 && l == LAYOUT_ROW_MAJOR){
+        gemv(m, k, a.data, a.rs, b.data, c);
+        error = max_error(m, 1, c, DTYPE_F64, 1, expected);
+        TEST_CHECK(error <= 1e-13 * k, "gemv %dx%d: error %g", m, k, error);
+    }
+
+    SAFE_FREE(a.data);
+    SAFE_FREE(b.data);
+    SAFE_FREE(c);
+    SAFE_FREE(doubled);
+    SAFE_FREE(expected);
+}
+
+/*
+The fp32 engine on float copies of the operands, a optionally stored as bf16. The reference takes the stored,
+rounded values so only the fp32 accumulation differs
+*/
+static void test_gemm_f32(int m, int n, int k, layout l, dtype a_type, unsigned long long * seed){
+    operand a = operand_init(m, k, l, 0, seed);
+    operand b = operand_init(k, n, l, 1, seed);
+
+    size_t a_size = (size_t)(m - 1) * a.rs + (size_t)(k - 1) * a.cs + 1;
+    size_t b_size = (size_t)(k - 1) * b.rs + (size_t)(n - 1) * b.cs + 1;
+    void * a_narrow = SAFE_MALLOC(dtype_size(a_type) * a_size);
+    float * b_narrow = (float *)SAFE_MALLOC(sizeof(float) * b_size);
+
+    // round the doubles to the stored values first
+    dtype_convert(a.data, DTYPE_F64, a_narrow, a_type, a_size);
+    dtype_convert(a_narrow, a_type, a.data, DTYPE_F64, a_size);
+    dtype_convert(b.data, DTYPE_F64, b_narrow, DTYPE_F32, b_size);
+    dtype_convert(b_narrow, DTYPE_F32, b.data, DTYPE_F64, b_size);
+
+    double * expected = reference(m, n, k, a, b);
+    float * c = (float *)SAFE_MALLOC(sizeof(float) * m * n);
+
+    gemm_f32_strided(m, n, k, a_narrow, a_type, a.rs, a.cs, b_narrow, DTYPE_F32, b.rs, b.cs, c, DTYPE_F32, n, 0);
+
+    double error = max_error(m, n, c, DTYPE_F32, n, expected);
+    TEST_CHECK(error <= 1e-6 * k, "gemm_f32_strided %s %dx%dx%d %s: error %g", dtype_name(a_type), m, n, k, layout_names[l], error);
+
+    gemm_f32_strided(m, n, k, a_narrow, a_type, a.rs, a.cs, b_narrow, DTYPE_F32, b.rs, b.cs, c, DTYPE_F32, n, 1);
+    for(int i = 0; i < m * n; i++){
+        expected[i] *= 2;
+    }
+    error = max_error(m, n, c, DTYPE_F32, n, expected);
+    TEST_CHECK(error <= 2e-6 * k, "gemm_f32_strided accumulate %s %dx%dx%d %s: error %g", dtype_name(a_type), m, n, k, layout_names[l], error);
+    for(int i = 0; i < m * n; i++){
+        expected[i] /= 2;
+    }
+
+    if(n == 1 && l == LAYOUT_ROW_MAJOR){
+        gemv_f32(m, k, a_narrow, a_type, a.rs, b_narrow, DTYPE_F32, c, DTYPE_F32);
+        error = max_error(m, 1, c, DTYPE_F32, 1, expected);
+        TEST_CHECK(error <= 1e-6 * k, "gemv_f32 %s %dx%d: error %g", dtype_name(a_type), m, k, error);
+    }
+
+    SAFE_FREE(a.data);
+    SAFE_FREE(b.data);
+    SAFE_FREE(a_narrow);
+    SAFE_FREE(b_narrow);
+    SAFE_FREE(c);
+    SAFE_FREE(expected);
+}
+
+/*
+a and b views of one buffer, x * x^T as a matrix times its own transposed view
+*/
+static void test_aliased_operands(int m, int k, unsigned long long * seed){
+    operand x = operand_init(m, k, LAYOUT_ROW_MAJOR, 0, seed);
+    operand x_t = {x.data, 1, k};
+    double * expected = reference(m, m, k, x, x_t);
+    double * c = (double *)SAFE_MALLOC(sizeof(double) * m * m);
+
+    gemm_strided(m, m, k, x.data, x.rs, x.cs, x_t.data, x_t.rs, x_t.cs, c, m, 0);
+
+    double error = max_error(m, m, c, DTYPE_F64, m, expected);
+    TEST_CHECK(error <= 1e-13 * k, "gemm_strided x * x^T %dx%d: error %g", m, k, error);
+
+    SAFE_FREE(x.data);
+    SAFE_FREE(c);
+    SAFE_FREE(expected);
+}
+
+int main(void){
+    // the serial kernels and the row split across the pool, whatever the host has
+    thread_pool_configure(4, 0);
+
+    int sizes[] = {1, GEMM_MR - 1, GEMM_MR + 1, GEMM_NR_F32 + 1, GEMM_MC + 1, GEMM_KC + 1};
+    unsigned long long seed = 1;
+
+    for(size_t i = 0; i < ARRAY_LENGTH(sizes); i++){
+        for(size_t j = 0; j < ARRAY_LENGTH(sizes); j++){
+            for(size_t p = 0; p < ARRAY_LENGTH(sizes); p++){
+                int m = sizes[i];
+                int n = sizes[j];
+                int k = sizes[p];
+
+                // the reference is the naive loop, keep the largest cubes out
+                if((long)m * n * k > (long)GEMM_MC * GEMM_KC * 40){
+                    continue;
+                }
+
+                for(int l = 0; l < LAYOUT_COUNT; l++){
+                    test_gemm_strided(m, n, k, l, &seed);
+                    test_gemm_f32(m, n, k, l, DTYPE_F32, &seed);
+                }
+                test_gemm_f32(m, n, k, LAYOUT_ROW_MAJOR, DTYPE_BF16, &seed);
+            }
+        }
+    }
+
+    test_aliased_operands(GEMM_MR + 1, GEMM_KC + 1, &seed);
+    test_aliased_operands(GEMM_MC + 1, 7, &seed);
+
+    thread_pool_shutdown();
+
+    return test_report("test_gemm");
+}
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include "lstm.h"
+#include "utils.h"
+
+#include "test.h"
+
+/*
+Checks lstm_backward against central differences of the loss sum_t <y_t, r_t> through lstm_forward_batch.
+The weights keep their default initialisation, so the gates reach pre-activations far from 0 where the
+rational activations of the forward pass and the exact sigmoid and tanh part ways
+*/
+
+#define STEPS 6
+#define BATCH 2
+#define FEATURES 3
+#define HIDDEN 5
+#define OUTPUTS 4
+
+#define EPSILON 1e-5
+#define TOLERANCE 1e-5
+
+static double element(tensor * t, int row, int col){
+    return tensor_data(t)[(long)row * tensor_strides(t)[0] + (long)col * tensor_strides(t)[1]];
+}
+
+static double * element_address(tensor * t, int row, int col){
+    return tensor_data(t) + (long)row * tensor_strides(t)[0] + (long)col * tensor_strides(t)[1];
+}
+
+static double loss(LSTM * lstm, tensor * inputs, tensor ** directions){
+    tensor ** outputs = lstm_forward_batch(lstm, inputs, BATCH);
+    double sum = 0.0;
+
+    for(int t = 0; t < STEPS; t++){
+        for(int i = 0; i < OUTPUTS; i++){
+            for(int b = 0; b < BATCH; b++){
+                sum += element(outputs[t], i, b) * element(directions[t], i, b);
+            }
+        }
+    }
+
+    return sum;
+}
+
+/*
+Central difference of the loss in one parameter against its analytic gradient
+*/
+static double gradient_error(LSTM * lstm, tensor * inputs, tensor ** directions, double * parameter, double analytic){
+    double value = *parameter;
+
+    *parameter = value + EPSILON;
+    double plus = loss(lstm, inputs, directions);
+    *parameter = value - EPSILON;
+    double minus = loss(lstm, inputs, directions);
+    *parameter = value;
+
+    double numeric = (plus - minus) / (2 * EPSILON);
+    double error = numeric - analytic;
+    double scale = (numeric < 0 ? -numeric : numeric) + (analytic < 0 ? -analytic : analytic) + 1e-6;
+
+    return (error < 0 ? -error : error) / scale;
+}
+
+static void test_backward(const char * name, int flags, int checkpoint_interval, unsigned long long * seed){
+    LSTM * lstm = lstm_init_with_flags(FEATURES + HIDDEN, HIDDEN, OUTPUTS, STEPS, flags);
+    if(checkpoint_interval > 0){
+        lstm_set_checkpoint_interval(lstm, checkpoint_interval);
+    }
+
+    int input_shape[2] = {BATCH * STEPS, FEATURES};
+    tensor * inputs = tensor_init(2, input_shape);
+    for(int i = 0; i < BATCH * STEPS * FEATURES; i++){
+        tensor_data(inputs)[i] = 2 * test_random(seed);
+    }
+
+    int direction_shape[2] = {OUTPUTS, BATCH};
+    tensor * directions[STEPS];
+    for(int t = 0; t < STEPS; t++){
+        directions[t] = tensor_init(2, direction_shape);
+        for(int i = 0; i < OUTPUTS * BATCH; i++){
+            tensor_data(directions[t])[i] = test_random(seed);
+        }
+    }
+
+    loss(lstm, inputs, directions);
+    lstm_gradients * gradients = lstm_gradients_init(lstm);
+    lstm_backward(lstm, directions, gradients);
+
+    lstm_weights * weights = lstm->weights;
+    tensor * gates[4] = {weights->Wf, weights->Wi, weights->Wc, weights->Wo};
+    tensor * d_gates[4] = {gradients->dWf, gradients->dWi, gradients->dWc, gradients->dWo};
+    double worst = 0.0;
+
+    for(int g = 0; g < 4; g++){
+        for(int i = 0; i < HIDDEN; i++){
+            for(int j = 0; j < FEATURES + HIDDEN; j++){
+                double error = gradient_error(lstm, inputs, directions, element_address(gates[g], i, j), element(d_gates[g], i, j));
+                worst = error > worst ? error : worst;
+            }
+        }
+    }
+    TEST_CHECK(worst <= TOLERANCE, "%s: gate weight gradients off by %g", name, worst);
+
+    worst = 0.0;
+    for(int i = 0; i < OUTPUTS; i++){
+        for(int j = 0; j < HIDDEN; j++){
+            double error = gradient_error(lstm, inputs, directions, element_address(weights->Wy, i, j), element(gradients->dWy, i, j));
+            worst = error > worst ? error : worst;
+        }
+    }
+    TEST_CHECK(worst <= TOLERANCE, "%s: projection gradients off by %g", name, worst);
+
+    // row b * STEPS + t of the inputs is column t * BATCH + b of d_input
+    worst = 0.0;
+    for(int b = 0; b < BATCH; b++){
+        for(int t = 0; t < STEPS; t++){
+            for(int f = 0; f < FEATURES; f++){
+                double error = gradient_error(lstm, inputs, directions, element_address(inputs, b * STEPS + t, f),
+                    element(gradients->d_input, f, t * BATCH + b)
+                );
+                worst = error > worst ? error : worst;
+            }
+        }
+    }
+    TEST_CHECK(worst <= TOLERANCE, "%s: input gradients off by %g", name, worst);
+
+    for(int t = 0; t < STEPS; t++){
+        tensor_cleanup(directions[t]);
+    }
+    tensor_cleanup(inputs);
+    lstm_gradients_cleanup(gradients);
+    lstm_cleanup(lstm);
+}
+
+int main(void){
+    unsigned long long seed = 1;
+
+    test_backward("unfused", LSTM_DEFAULT, 0, &seed);
+    test_backward("fused", LSTM_FUSED_GATES, 0, &seed);
+    test_backward("checkpointed", LSTM_FUSED_GATES, 4, &seed);
+
+    return test_report("test_lstm_backward");
+}
\ No newline at end of file